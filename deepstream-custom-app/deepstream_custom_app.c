@@ -33,6 +33,12 @@
 #include "nvds_yml_parser.h"
 #include "gst-nvmessage.h"
 
+#include "ds_custom_config.h"
+#include "ds_heatmap_stage.h"
+#include "ds_reid_stage.h"
+#include "ds_secondary_stage.h"
+#include "ds_source_pool.h"
+
 #define MAX_DISPLAY_LEN 64
 
 #define PGIE_CLASS_ID_PERSON 0
@@ -75,10 +81,6 @@ gchar SOURCE_NAMES[4][32] = { "CAM Quinta Normal - Calle #1",
 #define TILED_OUTPUT_WIDTH 1280
 #define TILED_OUTPUT_HEIGHT 720
 
-/* NVIDIA Decoder source pad memory feature. This feature signifies that source
- * pads having this capability will push GstBuffers containing cuda buffers. */
-#define GST_CAPS_FEATURES_NVMM "memory:NVMM"
-
 gchar pgie_classes_str[4][32] = { "Vehicle", "TwoWheeler", "Person",
   "RoadSign"
 };
@@ -233,103 +235,50 @@ bus_call (GstBus * bus, GstMessage * msg, gpointer data)
   return TRUE;
 }
 
-static void
-cb_newpad (GstElement * decodebin, GstPad * decoder_src_pad, gpointer data)
+/* Highest number of entries read from the output video-sources list. */
+#define MAX_LISTED_SOURCES 256
+
+/* get_video_outputs reads the output topology of the 'output' group and
+ * flags the sources that get an RTSP video output. With 'mode: metadata' no
+ * source does and the pipeline ends in a fakesink after the analytics.
+ * Otherwise 'video-sources' lists the source indices with video, all of them
+ * if it is missing. Returns the number of video outputs. */
+static guint
+get_video_outputs (const gchar * cfg_file_path, guint num_sources,
+    gboolean * video_output)
 {
-  GstCaps *caps = gst_pad_get_current_caps (decoder_src_pad);
-  if (!caps) {
-    caps = gst_pad_query_caps (decoder_src_pad, NULL);
-  }
-  const GstStructure *str = gst_caps_get_structure (caps, 0);
-  const gchar *name = gst_structure_get_name (str);
-  GstElement *source_bin = (GstElement *) data;
-  GstCapsFeatures *features = gst_caps_get_features (caps, 0);
-
-  /* Need to check if the pad created by the decodebin is for video and not
-   * audio. */
-  if (!strncmp (name, "video", 5)) {
-    /* Link the decodebin pad only if decodebin has picked nvidia
-     * decoder plugin nvdec_*. We do this by checking if the pad caps contain
-     * NVMM memory features. */
-    if (gst_caps_features_contains (features, GST_CAPS_FEATURES_NVMM)) {
-      /* Get the source bin ghost pad */
-      GstPad *bin_ghost_pad = gst_element_get_static_pad (source_bin, "src");
-      if (!gst_ghost_pad_set_target (GST_GHOST_PAD (bin_ghost_pad),
-              decoder_src_pad)) {
-        g_printerr ("Failed to link decoder src pad to source bin ghost pad\n");
-      }
-      gst_object_unref (bin_ghost_pad);
-    } else {
-      g_printerr ("Error: Decodebin did not pick nvidia decoder plugin.\n");
-    }
+  guint ids[MAX_LISTED_SOURCES];
+  guint num_ids = 0, num_outputs = 0, i;
+  gchar *mode = NULL;
+
+  if (ds_cfg_is_yml (cfg_file_path)) {
+    mode = ds_cfg_get_string (cfg_file_path, "output", "mode");
+    num_ids = ds_cfg_get_uint_list (cfg_file_path, "output", "video-sources",
+        ids, MAX_LISTED_SOURCES);
   }
-}
 
-static void
-decodebin_child_added (GstChildProxy * child_proxy, GObject * object,
-    gchar * name, gpointer user_data)
-{
-  g_print ("Decodebin child added: %s\n", name);
-  if (g_strrstr (name, "decodebin") == name) {
-    g_signal_connect (G_OBJECT (object), "child-added",
-        G_CALLBACK (decodebin_child_added), user_data);
+  for (i = 0; i < num_sources; i++)
+    video_output[i] = (num_ids == 0);
+  for (i = 0; i < num_ids; i++) {
+    if (ids[i] < num_sources)
+      video_output[ids[i]] = TRUE;
+    else
+      g_printerr ("WARNING: Ignoring video output of unknown source %u\n",
+          ids[i]);
   }
-  if (g_strrstr (name, "source") == name) {
-        g_object_set(G_OBJECT(object),"drop-on-latency",true,NULL);
+  if (!g_strcmp0 (mode, "metadata")) {
+    for (i = 0; i < num_sources; i++)
+      video_output[i] = FALSE;
+  } else if (mode && g_strcmp0 (mode, "video")) {
+    g_printerr ("WARNING: Unknown output mode '%s', using video\n", mode);
   }
+  g_free (mode);
 
-}
-
-static GstElement *
-create_source_bin (guint index, gchar * uri)
-{
-  GstElement *bin = NULL, *uri_decode_bin = NULL;
-  gchar bin_name[16] = { };
-
-  g_snprintf (bin_name, 15, "source-bin-%02d", index);
-  /* Create a source GstBin to abstract this bin's content from the rest of the
-   * pipeline */
-  bin = gst_bin_new (bin_name);
-
-  /* Source element for reading from the uri.
-   * We will use decodebin and let it figure out the container format of the
-   * stream and the codec and plug the appropriate demux and decode plugins. */
-  if (PERF_MODE) {
-    uri_decode_bin = gst_element_factory_make ("nvurisrcbin", "uri-decode-bin");
-    g_object_set (G_OBJECT (uri_decode_bin), "file-loop", TRUE, NULL);
-  } else {
-    uri_decode_bin = gst_element_factory_make ("uridecodebin", "uri-decode-bin");
-  }
-
-  if (!bin || !uri_decode_bin) {
-    g_printerr ("One element in source bin could not be created.\n");
-    return NULL;
-  }
-
-  /* We set the input uri to the source element */
-  g_object_set (G_OBJECT (uri_decode_bin), "uri", uri, NULL);
-
-  /* Connect to the "pad-added" signal of the decodebin which generates a
-   * callback once a new pad for raw data has beed created by the decodebin */
-  g_signal_connect (G_OBJECT (uri_decode_bin), "pad-added",
-      G_CALLBACK (cb_newpad), bin);
-  g_signal_connect (G_OBJECT (uri_decode_bin), "child-added",
-      G_CALLBACK (decodebin_child_added), bin);
-
-  gst_bin_add (GST_BIN (bin), uri_decode_bin);
-
-  /* We need to create a ghost pad for the source bin which will act as a proxy
-   * for the video decoder src pad. The ghost pad will not have a target right
-   * now. Once the decode bin creates the video decoder and generates the
-   * cb_newpad callback, we will set the ghost pad target to the video decoder
-   * src pad. */
-  if (!gst_element_add_pad (bin, gst_ghost_pad_new_no_target ("src",
-              GST_PAD_SRC))) {
-    g_printerr ("Failed to add ghost pad in source bin\n");
-    return NULL;
+  for (i = 0; i < num_sources; i++) {
+    if (video_output[i])
+      num_outputs++;
   }
-
-  return bin;
+  return num_outputs;
 }
 
 int
@@ -337,19 +286,26 @@ main (int argc, char *argv[])
 {
   GMainLoop *loop = NULL;
   GstElement *pipeline = NULL, *streammux = NULL, *streamdemux = NULL,
-      *pgie = NULL, *nvtracker = NULL, *nvdslogger = NULL, *queue = NULL, 
+      *pgie = NULL, *nvtracker = NULL, *sgie = NULL, *reid_gie = NULL,
+      *nvdslogger = NULL, *queue = NULL, *last = NULL, 
       *nvvidconv = NULL, *nvosd = NULL, *nvvidconv2 = NULL, *caps = NULL,
       *encoder = NULL, *rtppay = NULL, *sink = NULL;
   GstRTSPServer *server;
   GstRTSPMountPoints *mounts;
   GstRTSPMediaFactory *factory;
+  DsSecondaryStage *sgie_stage = NULL;
+  DsReidStage *reid_stage = NULL;
+  DsHeatmapStage *heatmap_stage = NULL;
+  DsSourcePool *source_pool = NULL;
+  gboolean *video_output = NULL;
   GstBus *bus = NULL;
   GstCaps* filtercaps = NULL;
   guint bus_watch_id;
   GstPad *tiler_src_pad = NULL;
-  guint i = 0, num_sources = 0;
+  guint i = 0, num_sources = 0, num_video_outputs = 0;
   guint tiler_rows, tiler_columns;
   guint pgie_batch_size;
+  guint muxer_width, muxer_height;
   gchar element_name[30] = { };
   gchar factory_launch[160] = { };
   gchar mount_point_path[20] = { };
@@ -404,45 +360,24 @@ main (int argc, char *argv[])
     num_sources = argc - 1;
   }
 
+  /* Source bins are linked to the streammux now but only started once the
+   * pipeline is playing, all at once, see ds_source_pool.h */
+  source_pool = ds_source_pool_new (argv[1], "source-startup", pipeline,
+      streammux, PERF_MODE);
   for (i = 0; i < num_sources; i++) {
-    GstPad *sinkpad, *srcpad;
-    gchar pad_name[16] = { };
+    gboolean added;
 
-    GstElement *source_bin = NULL;
     if (g_str_has_suffix (argv[1], ".yml") || g_str_has_suffix (argv[1], ".yaml")) {
       g_print("Now playing : %s\n",(char*)(src_list)->data);
-      source_bin = create_source_bin (i, (char*)(src_list)->data);
+      added = ds_source_pool_add (source_pool, i, (char*)(src_list)->data);
     } else {
-      source_bin = create_source_bin (i, argv[i + 1]);
+      added = ds_source_pool_add (source_pool, i, argv[i + 1]);
     }
-    if (!source_bin) {
+    if (!added) {
       g_printerr ("Failed to create source bin. Exiting.\n");
       return -1;
     }
 
-    gst_bin_add (GST_BIN (pipeline), source_bin);
-
-    g_snprintf (pad_name, 15, "sink_%u", i);
-    sinkpad = gst_element_get_request_pad (streammux, pad_name);
-    if (!sinkpad) {
-      g_printerr ("Streammux request sink pad failed. Exiting.\n");
-      return -1;
-    }
-
-    srcpad = gst_element_get_static_pad (source_bin, "src");
-    if (!srcpad) {
-      g_printerr ("Failed to get src pad of source bin. Exiting.\n");
-      return -1;
-    }
-
-    if (gst_pad_link (srcpad, sinkpad) != GST_PAD_LINK_OK) {
-      g_printerr ("Failed to link source bin to stream muxer. Exiting.\n");
-      return -1;
-    }
-
-    gst_object_unref (srcpad);
-    gst_object_unref (sinkpad);
-
     if (g_str_has_suffix (argv[1], ".yml") || g_str_has_suffix (argv[1], ".yaml")) {
       src_list = src_list->next;
     }
@@ -452,6 +387,14 @@ main (int argc, char *argv[])
     g_list_free(src_list);
   }
 
+  /* Decide which sources get a video output. Analytics only nodes build no
+   * demuxer, no per source branch and no RTSP server. */
+  video_output = g_new0 (gboolean, num_sources);
+  num_video_outputs = get_video_outputs (argv[1], num_sources, video_output);
+  if (num_video_outputs == 0) {
+    g_print ("No video output, running in metadata only mode\n");
+  }
+
   /* Use queue to buffer incoming data from pgie. */
   queue = gst_element_factory_make ("queue", "queue");
 
@@ -464,15 +407,59 @@ main (int argc, char *argv[])
   /* Use nvdslogger for perf measurement. */
   nvdslogger = gst_element_factory_make ("nvdslogger", "nvdslogger");
 
-  /* Use a nvstreamdemux to split each processed input on its own pipeline */
-  streamdemux = gst_element_factory_make ("nvstreamdemux", "stream-demuxer");
+  if (num_video_outputs > 0) {
+    /* Use a nvstreamdemux to split each processed input on its own pipeline */
+    streamdemux = gst_element_factory_make ("nvstreamdemux", "stream-demuxer");
+  } else {
+    /* Without video outputs the batches end here, after the analytics */
+    sink = gst_element_factory_make ("fakesink", "fakesink");
+  }
 
   /* Check if elements could be created successfully. */
-  if (!queue || !pgie || !nvtracker || !nvdslogger || !streamdemux) {
+  if (!queue || !pgie || !nvtracker || !nvdslogger || (!streamdemux && !sink)) {
     g_printerr ("One element could not be created. Exiting.\n");
     return -1;
   }
 
+  /* Use a secondary nvinfer to classify the tracked objects (optional). The
+   * stage caches its results per track so it does not run on every frame. */
+  if (ds_cfg_is_yml (argv[1])) {
+    sgie_stage = ds_secondary_stage_new (argv[1], "secondary-gie");
+  }
+  if (sgie_stage) {
+    sgie = gst_element_factory_make ("nvinfer", "secondary-nvinference-engine");
+    if (!sgie) {
+      g_printerr ("One element could not be created. Exiting.\n");
+      return -1;
+    }
+    g_object_set (G_OBJECT (sgie), "config-file-path",
+        ds_secondary_stage_get_config_file (sgie_stage), NULL);
+    ds_secondary_stage_set_display_labels (sgie_stage, num_video_outputs > 0);
+    if (!ds_secondary_stage_attach (sgie_stage, sgie)) {
+      g_printerr ("Failed to set up the secondary classifier. Exiting.\n");
+      return -1;
+    }
+  }
+
+  /* Use another secondary nvinfer to compute appearance embeddings for the
+   * cross-camera re-identification (optional). */
+  if (ds_cfg_is_yml (argv[1])) {
+    reid_stage = ds_reid_stage_new (argv[1], "reid");
+  }
+  if (reid_stage) {
+    reid_gie = gst_element_factory_make ("nvinfer", "reid-nvinference-engine");
+    if (!reid_gie) {
+      g_printerr ("One element could not be created. Exiting.\n");
+      return -1;
+    }
+    g_object_set (G_OBJECT (reid_gie), "config-file-path",
+        ds_reid_stage_get_config_file (reid_stage), NULL);
+    if (!ds_reid_stage_attach (reid_stage, reid_gie)) {
+      g_printerr ("Failed to set up the re-identification. Exiting.\n");
+      return -1;
+    }
+  }
+
   /*** Set the main pipeline elements properties ***/
   if (g_str_has_suffix (argv[1], ".yml") || g_str_has_suffix (argv[1], ".yaml")) {
 
@@ -517,22 +504,71 @@ main (int argc, char *argv[])
   }
 
 
+  if (sink) {
+    g_object_set (G_OBJECT (sink), "sync", 0, "async", 0, "qos", 0, NULL);
+  }
+
+
   /*** Add elements into the main pipeline ***/
-  gst_bin_add_many (GST_BIN (pipeline), queue, pgie, nvtracker, nvdslogger, 
-    streamdemux, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), queue, pgie, nvtracker, nvdslogger,
+    streamdemux ? streamdemux : sink, NULL);
+  if (sgie) {
+    gst_bin_add (GST_BIN (pipeline), sgie);
+  }
+  if (reid_gie) {
+    gst_bin_add (GST_BIN (pipeline), reid_gie);
+  }
 
 
   /*** Link the main pipeline elements together ***
-   * nvstreammux -> queue -> nvinfer -> nvtracker -> nvdslogger -> nvstreamdemux */
-  if (!gst_element_link_many (streammux, queue, pgie, nvtracker, nvdslogger, 
-    streamdemux, NULL)) {
+   * nvstreammux -> queue -> nvinfer -> nvtracker -> [nvinfer (sgie)] ->
+   * [nvinfer (reid)] -> nvdslogger -> nvstreamdemux (or fakesink) */
+  if (!gst_element_link_many (streammux, queue, pgie, nvtracker, NULL)) {
+    g_printerr ("Elements could not be linked. Exiting.\n");
+    return -1;
+  }
+  last = nvtracker;
+  if (sgie) {
+    if (!gst_element_link (last, sgie)) {
+      g_printerr ("Elements could not be linked. Exiting.\n");
+      return -1;
+    }
+    last = sgie;
+  }
+  if (reid_gie) {
+    if (!gst_element_link (last, reid_gie)) {
+      g_printerr ("Elements could not be linked. Exiting.\n");
+      return -1;
+    }
+    last = reid_gie;
+  }
+  if (!gst_element_link_many (last, nvdslogger,
+          streamdemux ? streamdemux : sink, NULL)) {
     g_printerr ("Elements could not be linked. Exiting.\n");
     return -1;
   }
 
+  /* Accumulate per camera occupancy heatmaps from the final object metadata
+   * (optional). */
+  if (ds_cfg_is_yml (argv[1])) {
+    g_object_get (G_OBJECT (streammux), "width", &muxer_width, "height",
+        &muxer_height, NULL);
+    heatmap_stage = ds_heatmap_stage_new (argv[1], "heatmap", num_sources,
+        muxer_width, muxer_height);
+  }
+  if (heatmap_stage && !ds_heatmap_stage_attach (heatmap_stage, last)) {
+    g_printerr ("Failed to set up the heatmaps. Exiting.\n");
+    return -1;
+  }
+
 
   /*** We create an individual pipeline for each stream demuxer output ***/
+  /* Sources without video output get no demuxer src pad, their frames are
+   * dropped by nvstreamdemux. */
   for (i = 0; i < num_sources; i++) {
+    if (!video_output[i]) {
+      continue;
+    }
 
     /*** Set the pipeline elements properties ***/
     /* Use queue to buffer incoming data from demuxer. */
@@ -658,71 +694,80 @@ main (int argc, char *argv[])
   gst_object_unref (bus);
 
 
-  /* Create an RTSP server instance */
-  server = gst_rtsp_server_new ();
-  g_object_set (server, "service", rtsp_port, NULL);
-
-  /* Attach the server to the default maincontext */
-  if (gst_rtsp_server_attach (server, NULL) == 0) {
-    g_printerr ("RTSP server could not be attached to maincontext. Exiting.\n");
-    return -1;
-  }
-
-  /* Add server authentification */
-  #ifdef WITH_AUTH
-    /* Make a new authentication manager. it can be added to control access to all
-     * the factories on the server or on individual factories. */
-    auth = gst_rtsp_auth_new ();
-    /* Make user token */
-    token = gst_rtsp_token_new (GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE, G_TYPE_STRING, "user", NULL);
-    basic = gst_rtsp_auth_make_basic ("user", "password");
-    gst_rtsp_auth_add_basic (auth, basic, token);
-    g_free (basic);
-    gst_rtsp_token_unref (token);
-    /* Configure in the server */
-    gst_rtsp_server_set_auth (server, auth);
-  #endif
-
-  /* We create an individual streamming mount point for each sink output */
-  for (i = 0; i < num_sources; i++) {
-
-    /* Make a media factory for a test stream. The default media factory can use
-     * gst-launch syntax to create pipelines.
-     * any launch line works as long as it contains elements named pay%d. Each
-     * element with pay%d names will be a stream */
-    factory = gst_rtsp_media_factory_new ();
-    g_snprintf (factory_launch, 150, 
-      "( udpsrc name=pay0 port=%d buffer-size=524288 caps=\"application/x-rtp, "
-      "media=video, clock-rate=90000, encoding-name=(string)%s, "
-      "payload=96 \" )", upd_port + i, codec);
-    gst_rtsp_media_factory_set_launch (factory, factory_launch);
-    gst_rtsp_media_factory_set_shared (factory, TRUE);
+  /* Create an RTSP server for the video outputs, if any */
+  if (num_video_outputs > 0) {
+    /* Create an RTSP server instance */
+    server = gst_rtsp_server_new ();
+    g_object_set (server, "service", rtsp_port, NULL);
 
-    /* Get the mount points for this server, every server has a default object
-     * that be used to map uri mount points to media factories */
-    mounts = gst_rtsp_server_get_mount_points (server);
+    /* Attach the server to the default maincontext */
+    if (gst_rtsp_server_attach (server, NULL) == 0) {
+      g_printerr ("RTSP server could not be attached to maincontext. Exiting.\n");
+      return -1;
+    }
 
-    /* Attach the test factory to the /ds-test-i url */
-    g_snprintf (mount_point_path, 150, "/ds-gpu0-%d", i);
-    gst_rtsp_mount_points_add_factory (mounts, mount_point_path, factory);
+    /* Add server authentification */
+    #ifdef WITH_AUTH
+      /* Make a new authentication manager. it can be added to control access to all
+       * the factories on the server or on individual factories. */
+      auth = gst_rtsp_auth_new ();
+      /* Make user token */
+      token = gst_rtsp_token_new (GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE, G_TYPE_STRING, "user", NULL);
+      basic = gst_rtsp_auth_make_basic ("user", "password");
+      gst_rtsp_auth_add_basic (auth, basic, token);
+      g_free (basic);
+      gst_rtsp_token_unref (token);
+      /* Configure in the server */
+      gst_rtsp_server_set_auth (server, auth);
+    #endif
+
+    /* We create an individual streamming mount point for each sink output */
+    for (i = 0; i < num_sources; i++) {
+      if (!video_output[i]) {
+        continue;
+      }
 
-    g_print ("*** DeepStream: Launched RTSP Streaming from Source #%d at "
-      "rtsp://localhost:%s%s ***\n", i, rtsp_port, mount_point_path);
+      /* Make a media factory for a test stream. The default media factory can use
+       * gst-launch syntax to create pipelines.
+       * any launch line works as long as it contains elements named pay%d. Each
+       * element with pay%d names will be a stream */
+      factory = gst_rtsp_media_factory_new ();
+      g_snprintf (factory_launch, 150, 
+        "( udpsrc name=pay0 port=%d buffer-size=524288 caps=\"application/x-rtp, "
+        "media=video, clock-rate=90000, encoding-name=(string)%s, "
+        "payload=96 \" )", upd_port + i, codec);
+      gst_rtsp_media_factory_set_launch (factory, factory_launch);
+      gst_rtsp_media_factory_set_shared (factory, TRUE);
+
+      /* Get the mount points for this server, every server has a default object
+       * that be used to map uri mount points to media factories */
+      mounts = gst_rtsp_server_get_mount_points (server);
+
+      /* Attach the test factory to the /ds-test-i url */
+      g_snprintf (mount_point_path, 150, "/ds-gpu0-%d", i);
+      gst_rtsp_mount_points_add_factory (mounts, mount_point_path, factory);
+
+      g_print ("*** DeepStream: Launched RTSP Streaming from Source #%d at "
+        "rtsp://localhost:%s%s ***\n", i, rtsp_port, mount_point_path);
+    }
+    /* Don't need the ref to the mapper anymore */
+    g_object_unref (mounts);
   }
-  /* Don't need the ref to the mapper anymore */
-  g_object_unref (mounts);
 
 
   /* Lets add probe to get informed of the meta data generated, we add probe to
    * the sink pad of the osd element, since by that time, the buffer would have
-   * had got all the metadata. */
-  tiler_src_pad = gst_element_get_static_pad (pgie, "src");
-  if (!tiler_src_pad)
-    g_print ("Unable to get src pad\n");
-  else
-    gst_pad_add_probe (tiler_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
-        tiler_src_pad_buffer_probe, NULL, NULL);
-  gst_object_unref (tiler_src_pad);
+   * had got all the metadata. It only sets up drawing, so it is not needed
+   * without video outputs. */
+  if (num_video_outputs > 0) {
+    tiler_src_pad = gst_element_get_static_pad (pgie, "src");
+    if (!tiler_src_pad)
+      g_print ("Unable to get src pad\n");
+    else
+      gst_pad_add_probe (tiler_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+          tiler_src_pad_buffer_probe, NULL, NULL);
+    gst_object_unref (tiler_src_pad);
+  }
 
 
   /* Set the pipeline to "playing" state */
@@ -736,7 +781,12 @@ main (int argc, char *argv[])
     }
     g_print ("\n");
   }
+  if (!ds_source_pool_attach (source_pool, pgie)) {
+    g_printerr ("Failed to set up the source startup timing. Exiting.\n");
+    return -1;
+  }
   gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  ds_source_pool_start (source_pool);
 
 
   /* Wait till pipeline encounters an error or EOS */
@@ -745,9 +795,22 @@ main (int argc, char *argv[])
 
   /* Out of the main loop, clean up nicely */
   g_print ("Returned, stopping playback\n");
+  ds_source_pool_stop (source_pool);
   gst_element_set_state (pipeline, GST_STATE_NULL);
+  ds_source_pool_print_stats (source_pool);
+  if (sgie_stage) {
+    ds_secondary_stage_print_stats (sgie_stage);
+  }
+  if (reid_stage) {
+    ds_reid_stage_print_stats (reid_stage);
+  }
   g_print ("Deleting pipeline\n");
   gst_object_unref (GST_OBJECT (pipeline));
+  ds_secondary_stage_free (sgie_stage);
+  ds_reid_stage_free (reid_stage);
+  ds_heatmap_stage_free (heatmap_stage);
+  ds_source_pool_free (source_pool);
+  g_free (video_output);
   g_source_remove (bus_watch_id);
   g_main_loop_unref (loop);
   return 0;
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds_custom_config.h"
+
+gboolean
+ds_cfg_is_yml (const gchar * path)
+{
+  return path && (g_str_has_suffix (path, ".yml") ||
+      g_str_has_suffix (path, ".yaml"));
+}
+
+/* Strips an inline "# comment" and surrounding quotes from a value. */
+static gchar *
+clean_value (const gchar * raw)
+{
+  gchar *value = g_strdup (raw);
+  gchar *p;
+
+  for (p = value; *p; p++) {
+    if (*p == '#' && (p == value || g_ascii_isspace (p[-1]))) {
+      *p = '\0';
+      break;
+    }
+  }
+  g_strstrip (value);
+
+  gsize len = strlen (value);
+  if (len >= 2 && (value[0] == '"' || value[0] == '\'') &&
+      value[len - 1] == value[0]) {
+    value[len - 1] = '\0';
+    memmove (value, value + 1, len - 1);
+  }
+  return value;
+}
+
+gchar *
+ds_cfg_get_string (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key)
+{
+  gchar *contents = NULL;
+  gchar **lines = NULL;
+  gchar *result = NULL;
+  gboolean in_group = FALSE;
+  gsize key_len = strlen (key);
+  guint i;
+
+  if (!cfg_file_path ||
+      !g_file_get_contents (cfg_file_path, &contents, NULL, NULL))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; lines[i] && !result; i++) {
+    gchar *line = lines[i];
+    gboolean indented = g_ascii_isspace (line[0]);
+    gchar *stripped;
+
+    stripped = g_strstrip (line);
+    if (*stripped == '\0' || *stripped == '#')
+      continue;
+
+    /* Unindented lines open a new top level group */
+    if (!indented) {
+      gsize group_len = strlen (group);
+      in_group = !strncmp (stripped, group, group_len) &&
+          stripped[group_len] == ':';
+      continue;
+    }
+
+    if (in_group && !strncmp (stripped, key, key_len) &&
+        stripped[key_len] == ':') {
+      result = clean_value (stripped + key_len + 1);
+    }
+  }
+
+  g_strfreev (lines);
+  g_free (contents);
+  return result;
+}
+
+gint
+ds_cfg_get_int (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key, gint default_value)
+{
+  gchar *value = ds_cfg_get_string (cfg_file_path, group, key);
+  gint result = default_value;
+
+  if (value && *value)
+    result = (gint) strtol (value, NULL, 10);
+  g_free (value);
+  return result;
+}
+
+gdouble
+ds_cfg_get_double (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key, gdouble default_value)
+{
+  gchar *value = ds_cfg_get_string (cfg_file_path, group, key);
+  gdouble result = default_value;
+
+  if (value && *value)
+    result = g_ascii_strtod (value, NULL);
+  g_free (value);
+  return result;
+}
+
+guint
+ds_cfg_get_uint_list (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key, guint * values, guint max_values)
+{
+  gchar *value = ds_cfg_get_string (cfg_file_path, group, key);
+  gchar **tokens;
+  guint i, count = 0;
+
+  if (!value)
+    return 0;
+
+  tokens = g_strsplit (value, ";", -1);
+  for (i = 0; tokens[i] && count < max_values; i++) {
+    g_strstrip (tokens[i]);
+    if (*tokens[i])
+      values[count++] = (guint) strtoul (tokens[i], NULL, 10);
+  }
+
+  g_strfreev (tokens);
+  g_free (value);
+  return count;
+}
+
+guint
+ds_cfg_get_class_mask (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key, gboolean * mask)
+{
+  guint class_ids[DS_CFG_MAX_CLASSES];
+  guint num_class_ids, i;
+
+  num_class_ids = ds_cfg_get_uint_list (cfg_file_path, group, key, class_ids,
+      DS_CFG_MAX_CLASSES);
+  for (i = 0; i < DS_CFG_MAX_CLASSES; i++)
+    mask[i] = (num_class_ids == 0);
+  for (i = 0; i < num_class_ids; i++) {
+    if (class_ids[i] < DS_CFG_MAX_CLASSES)
+      mask[class_ids[i]] = TRUE;
+  }
+  return num_class_ids;
+}
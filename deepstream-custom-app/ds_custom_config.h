@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __DS_CUSTOM_CONFIG_H__
+#define __DS_CUSTOM_CONFIG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The nvds_yml_parser library only knows about the stock DeepStream groups
+ * (streammux, osd, tracker, ...). These helpers read the application specific
+ * groups of ds_config.yml, which are flat "key: value" maps:
+ *
+ *   group:
+ *     key: value
+ *
+ * Missing files, groups or keys are not errors: the getters return the
+ * supplied default so every custom group stays optional. */
+
+/* Returns TRUE if 'path' names a yml configuration file. */
+gboolean ds_cfg_is_yml (const gchar * path);
+
+/* Returns a newly allocated copy of the value or NULL if not found. */
+gchar *ds_cfg_get_string (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key);
+
+gint ds_cfg_get_int (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key, gint default_value);
+
+gdouble ds_cfg_get_double (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key, gdouble default_value);
+
+/* Parses a semicolon separated list of unsigned integers, e.g. "2;5;7;", into
+ * 'values'. Returns the number of values stored (at most 'max_values'). */
+guint ds_cfg_get_uint_list (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key, guint * values, guint max_values);
+
+/* Highest class id + 1 that can be selected in a class list. */
+#define DS_CFG_MAX_CLASSES 256
+
+/* Parses a class id list like ds_cfg_get_uint_list () into 'mask', which has
+ * DS_CFG_MAX_CLASSES entries. Returns the number of ids listed; when there is
+ * no list every class is selected and 0 is returned. */
+guint ds_cfg_get_class_mask (const gchar * cfg_file_path, const gchar * group,
+    const gchar * key, gboolean * mask);
+
+/* Whether 'class_id' is selected in a mask read by ds_cfg_get_class_mask (). */
+static inline gboolean
+ds_cfg_class_selected (const gboolean * mask, gint class_id)
+{
+  return class_id >= 0 && class_id < DS_CFG_MAX_CLASSES && mask[class_id];
+}
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "gstnvdsmeta.h"
+#include "ds_custom_config.h"
+#include "ds_heatmap_stage.h"
+
+/* Cells are renormalized once their grid scale grows past this. */
+#define RENORMALIZE_ABOVE 1e6
+
+/* A grid waiting for its turn is renormalized at once past this, so its
+ * scale cannot overflow between two turns. */
+#define RENORMALIZE_NOW 1e100
+
+typedef enum
+{
+  FOOTPRINT_BOX,
+  FOOTPRINT_POINT,
+} DsHeatmapFootprint;
+
+typedef enum
+{
+  FORMAT_PNG,
+  FORMAT_RAW,
+} DsHeatmapFormat;
+
+/* Snapshot buffer ownership */
+enum
+{
+  SNAPSHOT_IDLE,
+  SNAPSHOT_COPYING,
+  SNAPSHOT_READY,
+  SNAPSHOT_WRITING,
+};
+
+struct _DsHeatmapStage
+{
+  guint width;
+  guint height;
+  guint stride;
+  gsize cells;
+  guint num_sources;
+  guint num_classes;
+  guint num_grids;
+  gint class_slot[DS_CFG_MAX_CLASSES];
+  guint slot_class[DS_CFG_MAX_CLASSES];
+  gdouble x_cells_per_pixel;
+  gdouble y_cells_per_pixel;
+  DsHeatmapFootprint footprint;
+  gdouble half_life;
+  gint64 snapshot_interval;
+  DsHeatmapFormat format;
+  gchar *output_dir;
+
+  /* Streaming thread only. A grid holds a (width + 1) x (height + 1)
+   * difference array whose cells are 'scale' times the decayed values. */
+  gdouble *delta;
+  gdouble *scale;
+  gint64 last_time;
+  gint64 next_snapshot;
+  guint renormalize_cursor;
+  guint copy_cursor;
+
+  GMutex lock;
+  GCond cond;
+  gint snapshot_state;
+  gboolean stop;
+  gdouble *snapshot;
+  gdouble *snapshot_scale;
+  guint64 skipped;
+  GThread *writer;
+
+  /* Writer thread only */
+  gdouble *column;
+  gfloat *heat;
+  guint8 *pixels;
+  guint32 crc_table[256];
+};
+
+static void
+add_footprint (DsHeatmapStage * stage, guint grid, NvOSD_RectParams * rect)
+{
+  gdouble *delta = stage->delta + (gsize) grid * stage->cells;
+  gdouble value = stage->scale[grid];
+  guint x0, y0, x1, y1;
+
+  if (stage->footprint == FOOTPRINT_POINT) {
+    gdouble cx = (rect->left + rect->width / 2) * stage->x_cells_per_pixel;
+    gdouble cy = (rect->top + rect->height) * stage->y_cells_per_pixel;
+    x0 = (guint) CLAMP (cx, 0, stage->width - 1);
+    y0 = (guint) CLAMP (cy, 0, stage->height - 1);
+    x1 = x0 + 1;
+    y1 = y0 + 1;
+  } else {
+    x0 = (guint) CLAMP (rect->left * stage->x_cells_per_pixel, 0,
+        stage->width - 1);
+    y0 = (guint) CLAMP (rect->top * stage->y_cells_per_pixel, 0,
+        stage->height - 1);
+    x1 = (guint) CLAMP (ceil ((rect->left + rect->width) *
+            stage->x_cells_per_pixel), x0 + 1, stage->width);
+    y1 = (guint) CLAMP (ceil ((rect->top + rect->height) *
+            stage->y_cells_per_pixel), y0 + 1, stage->height);
+  }
+
+  delta[y0 * stage->stride + x0] += value;
+  delta[y0 * stage->stride + x1] -= value;
+  delta[y1 * stage->stride + x0] -= value;
+  delta[y1 * stage->stride + x1] += value;
+}
+
+/* Folds the scale of a grid back into its cells. */
+static void
+renormalize_grid (DsHeatmapStage * stage, guint grid)
+{
+  gdouble *restrict delta = stage->delta + (gsize) grid * stage->cells;
+  gdouble factor = 1.0 / stage->scale[grid];
+  gsize i;
+
+  for (i = 0; i < stage->cells; i++)
+    delta[i] *= factor;
+  stage->scale[grid] = 1.0;
+}
+
+/* Renormalizes the grids in turn, a grid per frame. */
+static void
+renormalize_next_grid (DsHeatmapStage * stage)
+{
+  guint grid = stage->renormalize_cursor;
+
+  stage->renormalize_cursor = (grid + 1) % stage->num_grids;
+  if (stage->scale[grid] >= RENORMALIZE_ABOVE)
+    renormalize_grid (stage, grid);
+}
+
+/* Copies one grid per frame into the snapshot buffer and wakes the writer
+ * once all of them are there. */
+static void
+advance_snapshot (DsHeatmapStage * stage, gint64 now)
+{
+  guint grid;
+
+  if (now >= stage->next_snapshot) {
+    stage->next_snapshot = now + stage->snapshot_interval;
+    g_mutex_lock (&stage->lock);
+    if (stage->snapshot_state == SNAPSHOT_IDLE) {
+      stage->snapshot_state = SNAPSHOT_COPYING;
+      stage->copy_cursor = 0;
+    } else {
+      stage->skipped++;
+    }
+    g_mutex_unlock (&stage->lock);
+  }
+
+  if (g_atomic_int_get (&stage->snapshot_state) != SNAPSHOT_COPYING)
+    return;
+
+  grid = stage->copy_cursor++;
+  memcpy (stage->snapshot + (gsize) grid * stage->cells,
+      stage->delta + (gsize) grid * stage->cells,
+      stage->cells * sizeof (gdouble));
+  stage->snapshot_scale[grid] = stage->scale[grid];
+
+  if (stage->copy_cursor == stage->num_grids) {
+    g_mutex_lock (&stage->lock);
+    stage->snapshot_state = SNAPSHOT_READY;
+    g_cond_signal (&stage->cond);
+    g_mutex_unlock (&stage->lock);
+  }
+}
+
+/* heatmap_src_pad_buffer_probe accumulates the object footprints of every
+ * frame into the grid of their source and class. */
+static GstPadProbeReturn
+heatmap_src_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  DsHeatmapStage *stage = (DsHeatmapStage *) u_data;
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsMetaList *l_frame = NULL;
+  NvDsMetaList *l_obj = NULL;
+  gint64 now = g_get_monotonic_time ();
+  guint grid;
+
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+
+  /* Decay: growing the scale shrinks everything accumulated so far */
+  if (stage->half_life > 0 && stage->last_time > 0) {
+    gdouble growth = exp2 ((now - stage->last_time) /
+        (stage->half_life * G_USEC_PER_SEC));
+
+    if (growth > RENORMALIZE_ABOVE) {
+      /* After a long gap without batches everything has decayed away */
+      memset (stage->delta, 0,
+          stage->cells * stage->num_grids * sizeof (gdouble));
+      for (grid = 0; grid < stage->num_grids; grid++)
+        stage->scale[grid] = 1.0;
+    } else {
+      for (grid = 0; grid < stage->num_grids; grid++) {
+        stage->scale[grid] *= growth;
+        if (stage->scale[grid] > RENORMALIZE_NOW)
+          renormalize_grid (stage, grid);
+      }
+    }
+  }
+  stage->last_time = now;
+
+  for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
+
+    if (frame_meta->source_id >= stage->num_sources)
+      continue;
+
+    for (l_obj = frame_meta->obj_meta_list; l_obj != NULL;
+        l_obj = l_obj->next) {
+      NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) (l_obj->data);
+      gint slot;
+
+      if (obj_meta->class_id < 0 ||
+          obj_meta->class_id >= DS_CFG_MAX_CLASSES)
+        continue;
+      slot = stage->class_slot[obj_meta->class_id];
+      if (slot < 0)
+        continue;
+
+      add_footprint (stage,
+          frame_meta->source_id * stage->num_classes + slot,
+          &obj_meta->rect_params);
+    }
+  }
+
+  renormalize_next_grid (stage);
+  advance_snapshot (stage, now);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+make_crc_table (guint32 * table)
+{
+  guint32 n, k, c;
+
+  for (n = 0; n < 256; n++) {
+    c = n;
+    for (k = 0; k < 8; k++)
+      c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    table[n] = c;
+  }
+}
+
+static void
+append_be32 (GByteArray * out, guint32 value)
+{
+  guint8 bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+  g_byte_array_append (out, bytes, 4);
+}
+
+static void
+append_png_chunk (DsHeatmapStage * stage, GByteArray * out,
+    const gchar * type, const guint8 * data, guint len)
+{
+  guint32 crc = 0xffffffffu;
+  guint start, i;
+
+  append_be32 (out, len);
+  start = out->len;
+  g_byte_array_append (out, (const guint8 *) type, 4);
+  if (len)
+    g_byte_array_append (out, data, len);
+  for (i = start; i < out->len; i++)
+    crc = stage->crc_table[(crc ^ out->data[i]) & 0xff] ^ (crc >> 8);
+  append_be32 (out, crc ^ 0xffffffffu);
+}
+
+/* 8 bit grayscale PNG. The image data uses stored (uncompressed) deflate
+ * blocks, which keeps the writer free of a zlib dependency; a 192x108
+ * heatmap is ~21 KB. */
+static gboolean
+write_png (DsHeatmapStage * stage, const gchar * path)
+{
+  guint w = stage->width, h = stage->height;
+  guint raw_len = (w + 1) * h;
+  GByteArray *png = g_byte_array_new ();
+  GByteArray *zlib = g_byte_array_new ();
+  guint8 header[13];
+  guint32 adler_a = 1, adler_b = 0;
+  guint8 *raw = g_malloc (raw_len);
+  guint y, offset;
+  gboolean ok;
+  static const guint8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+  static const guint8 zlib_header[2] = { 0x78, 0x01 };
+
+  /* Scanlines with filter type 0 */
+  for (y = 0; y < h; y++) {
+    raw[y * (w + 1)] = 0;
+    memcpy (raw + y * (w + 1) + 1, stage->pixels + y * w, w);
+  }
+
+  g_byte_array_append (zlib, zlib_header, 2);
+  for (offset = 0; offset < raw_len;) {
+    guint len = MIN (raw_len - offset, 65535);
+    guint8 block[5] = { offset + len == raw_len, len & 0xff, len >> 8,
+      ~len & 0xff, (~len >> 8) & 0xff
+    };
+    g_byte_array_append (zlib, block, 5);
+    g_byte_array_append (zlib, raw + offset, len);
+    offset += len;
+  }
+  for (offset = 0; offset < raw_len; offset++) {
+    adler_a = (adler_a + raw[offset]) % 65521;
+    adler_b = (adler_b + adler_a) % 65521;
+  }
+  append_be32 (zlib, (adler_b << 16) | adler_a);
+
+  g_byte_array_append (png, signature, 8);
+  header[0] = w >> 24;
+  header[1] = w >> 16;
+  header[2] = w >> 8;
+  header[3] = w;
+  header[4] = h >> 24;
+  header[5] = h >> 16;
+  header[6] = h >> 8;
+  header[7] = h;
+  header[8] = 8;                /* bit depth */
+  header[9] = 0;                /* grayscale */
+  header[10] = header[11] = header[12] = 0;
+  append_png_chunk (stage, png, "IHDR", header, 13);
+  append_png_chunk (stage, png, "IDAT", zlib->data, zlib->len);
+  append_png_chunk (stage, png, "IEND", NULL, 0);
+
+  ok = g_file_set_contents (path, (const gchar *) png->data, png->len, NULL);
+
+  g_free (raw);
+  g_byte_array_free (zlib, TRUE);
+  g_byte_array_free (png, TRUE);
+  return ok;
+}
+
+/* Integrates the difference array of one grid into stage->heat. Returns the
+ * largest value. */
+static gfloat
+integrate_grid (DsHeatmapStage * stage, const gdouble * delta, gdouble scale)
+{
+  gdouble *column = stage->column;
+  gfloat max_heat = 0.0f;
+  guint x, y;
+
+  memset (column, 0, stage->width * sizeof (gdouble));
+  for (y = 0; y < stage->height; y++) {
+    const gdouble *row = delta + y * stage->stride;
+    gfloat *out = stage->heat + y * stage->width;
+    gdouble acc = 0.0;
+
+    for (x = 0; x < stage->width; x++)
+      column[x] += row[x];
+    for (x = 0; x < stage->width; x++) {
+      acc += column[x];
+      /* Rounding leaves tiny negatives where boxes cancelled out */
+      out[x] = (gfloat) MAX (acc / scale, 0.0);
+      max_heat = MAX (max_heat, out[x]);
+    }
+  }
+  return max_heat;
+}
+
+static void
+write_snapshot (DsHeatmapStage * stage, const gdouble * grids,
+    const gdouble * scales)
+{
+  guint grid;
+
+  for (grid = 0; grid < stage->num_grids; grid++) {
+    guint source = grid / stage->num_classes;
+    guint class_id = stage->slot_class[grid % stage->num_classes];
+    gfloat max_heat = integrate_grid (stage,
+        grids + (gsize) grid * stage->cells, scales[grid]);
+    gchar *name, *path;
+    gboolean ok;
+
+    name = g_strdup_printf ("source%u_class%u.%s", source, class_id,
+        stage->format == FORMAT_PNG ? "png" : "raw");
+    path = g_build_filename (stage->output_dir, name, NULL);
+
+    if (stage->format == FORMAT_PNG) {
+      gsize i, n = (gsize) stage->width * stage->height;
+      for (i = 0; i < n; i++)
+        stage->pixels[i] = max_heat > 0.0f ?
+            (guint8) (255.0f * stage->heat[i] / max_heat + 0.5f) : 0;
+      ok = write_png (stage, path);
+    } else {
+      ok = g_file_set_contents (path, (const gchar *) stage->heat,
+          (gssize) stage->width * stage->height * sizeof (gfloat), NULL);
+    }
+    if (!ok)
+      g_printerr ("WARNING: Failed to write heatmap %s\n", path);
+
+    g_free (name);
+    g_free (path);
+  }
+}
+
+static gpointer
+writer_thread_func (gpointer data)
+{
+  DsHeatmapStage *stage = (DsHeatmapStage *) data;
+
+  g_mutex_lock (&stage->lock);
+  for (;;) {
+    while (stage->snapshot_state != SNAPSHOT_READY && !stage->stop)
+      g_cond_wait (&stage->cond, &stage->lock);
+    if (stage->stop)
+      break;
+
+    stage->snapshot_state = SNAPSHOT_WRITING;
+    g_mutex_unlock (&stage->lock);
+
+    write_snapshot (stage, stage->snapshot, stage->snapshot_scale);
+
+    g_mutex_lock (&stage->lock);
+    stage->snapshot_state = SNAPSHOT_IDLE;
+  }
+  g_mutex_unlock (&stage->lock);
+  return NULL;
+}
+
+DsHeatmapStage *
+ds_heatmap_stage_new (const gchar * cfg_file_path, const gchar * group,
+    guint num_sources, guint frame_width, guint frame_height)
+{
+  DsHeatmapStage *stage = NULL;
+  gboolean class_selected[DS_CFG_MAX_CLASSES];
+  guint i;
+  gchar *value;
+  static const guint default_classes[] = { 0, 2, 5, 7 };
+
+  if (!ds_cfg_get_int (cfg_file_path, group, "enable", 0))
+    return NULL;
+
+  stage = g_new0 (DsHeatmapStage, 1);
+  stage->width = MAX (1, ds_cfg_get_int (cfg_file_path, group, "width", 192));
+  stage->height = MAX (1, ds_cfg_get_int (cfg_file_path, group, "height",
+          108));
+  stage->stride = stage->width + 1;
+  stage->cells = (gsize) stage->stride * (stage->height + 1);
+  stage->x_cells_per_pixel = (gdouble) stage->width / MAX (frame_width, 1);
+  stage->y_cells_per_pixel = (gdouble) stage->height / MAX (frame_height, 1);
+  stage->half_life = MAX (0.0, ds_cfg_get_double (cfg_file_path, group,
+          "half-life", 600.0));
+  stage->snapshot_interval = (gint64) (MAX (1.0,
+          ds_cfg_get_double (cfg_file_path, group, "snapshot-interval",
+              60.0)) * G_USEC_PER_SEC);
+
+  value = ds_cfg_get_string (cfg_file_path, group, "footprint");
+  stage->footprint = !g_strcmp0 (value, "point") ? FOOTPRINT_POINT :
+      FOOTPRINT_BOX;
+  g_free (value);
+  value = ds_cfg_get_string (cfg_file_path, group, "format");
+  stage->format = !g_strcmp0 (value, "raw") ? FORMAT_RAW : FORMAT_PNG;
+  g_free (value);
+  stage->output_dir = ds_cfg_get_string (cfg_file_path, group, "output-dir");
+  if (!stage->output_dir)
+    stage->output_dir = g_strdup ("heatmaps");
+  if (g_mkdir_with_parents (stage->output_dir, 0755) != 0)
+    g_printerr ("WARNING: Cannot create heatmap directory %s\n",
+        stage->output_dir);
+
+  /* Every class costs a grid per source, so only the usual ones by default:
+   * person, car, bus and truck */
+  if (ds_cfg_get_class_mask (cfg_file_path, group, "classes",
+          class_selected) == 0) {
+    memset (class_selected, 0, sizeof (class_selected));
+    for (i = 0; i < G_N_ELEMENTS (default_classes); i++)
+      class_selected[default_classes[i]] = TRUE;
+  }
+  for (i = 0; i < DS_CFG_MAX_CLASSES; i++) {
+    stage->class_slot[i] = -1;
+    if (class_selected[i]) {
+      stage->slot_class[stage->num_classes] = i;
+      stage->class_slot[i] = stage->num_classes++;
+    }
+  }
+  if (stage->num_classes == 0) {
+    g_printerr ("ERROR: No class id below %d in heatmap classes\n",
+        DS_CFG_MAX_CLASSES);
+    g_free (stage->output_dir);
+    g_free (stage);
+    return NULL;
+  }
+
+  stage->num_sources = MAX (num_sources, 1);
+  stage->num_grids = stage->num_sources * stage->num_classes;
+  /* Touched here so the first frames and snapshot do not page fault */
+  stage->delta = g_new (gdouble, stage->cells * stage->num_grids);
+  stage->snapshot = g_new (gdouble, stage->cells * stage->num_grids);
+  memset (stage->delta, 0, stage->cells * stage->num_grids * sizeof (gdouble));
+  memset (stage->snapshot, 0,
+      stage->cells * stage->num_grids * sizeof (gdouble));
+  stage->scale = g_new (gdouble, stage->num_grids);
+  stage->snapshot_scale = g_new (gdouble, stage->num_grids);
+  for (i = 0; i < stage->num_grids; i++)
+    stage->scale[i] = 1.0;
+  stage->column = g_new0 (gdouble, stage->width);
+  stage->heat = g_new0 (gfloat, (gsize) stage->width * stage->height);
+  stage->pixels = g_new0 (guint8, (gsize) stage->width * stage->height);
+  stage->next_snapshot = g_get_monotonic_time () + stage->snapshot_interval;
+  make_crc_table (stage->crc_table);
+
+  g_mutex_init (&stage->lock);
+  g_cond_init (&stage->cond);
+  stage->writer = g_thread_new ("heatmap-writer", writer_thread_func, stage);
+  return stage;
+}
+
+gboolean
+ds_heatmap_stage_attach (DsHeatmapStage * stage, GstElement * element)
+{
+  GstPad *src_pad = gst_element_get_static_pad (element, "src");
+
+  if (!src_pad) {
+    g_printerr ("Unable to get heatmap src pad\n");
+    return FALSE;
+  }
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      heatmap_src_pad_buffer_probe, stage, NULL);
+  gst_object_unref (src_pad);
+  return TRUE;
+}
+
+void
+ds_heatmap_stage_free (DsHeatmapStage * stage)
+{
+  if (!stage)
+    return;
+
+  g_mutex_lock (&stage->lock);
+  stage->stop = TRUE;
+  g_cond_signal (&stage->cond);
+  g_mutex_unlock (&stage->lock);
+  g_thread_join (stage->writer);
+
+  /* The pipeline is stopped, the live grids can be written directly */
+  write_snapshot (stage, stage->delta, stage->scale);
+
+  g_mutex_clear (&stage->lock);
+  g_cond_clear (&stage->cond);
+  g_free (stage->delta);
+  g_free (stage->snapshot);
+  g_free (stage->scale);
+  g_free (stage->snapshot_scale);
+  g_free (stage->column);
+  g_free (stage->heat);
+  g_free (stage->pixels);
+  g_free (stage->output_dir);
+  g_free (stage);
+}
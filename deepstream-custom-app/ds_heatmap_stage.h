@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __DS_HEATMAP_STAGE_H__
+#define __DS_HEATMAP_STAGE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Per camera, per class occupancy heatmaps built from the object metadata.
+ *
+ * Each (source, class) pair owns a 'width' x 'height' grid covering the
+ * muxer frame. Every frame each object adds 1 to the cells under its box (or
+ * under its bottom center point with 'footprint: point'), so a cell holds
+ * the frames of presence it saw. Old activity fades with an exponential
+ * decay of 'half-life' seconds, 0 keeping everything.
+ *
+ * To keep the streaming thread flat:
+ *   - grids store a 2D difference array, so a box costs 4 writes whatever
+ *     its size and the heat is only integrated when a snapshot is written;
+ *   - decay multiplies one scale factor per grid instead of every cell, and
+ *     the cells are renormalized one grid per frame when the factor grows;
+ *   - snapshots are copied one grid per frame and written by a worker
+ *     thread every 'snapshot-interval' seconds as 8 bit grayscale PNG scaled
+ *     to the grid maximum, or as raw native endian float32 ('format: raw').
+ * No memory is allocated on the streaming thread.
+ *
+ * ds_config.yml group:
+ *   heatmap:
+ *     enable: 1
+ *     width: 192
+ *     height: 108
+ *     classes: 0;2;5;7;
+ *     footprint: box
+ *     half-life: 600
+ *     snapshot-interval: 60
+ *     format: png
+ *     output-dir: heatmaps
+ */
+
+typedef struct _DsHeatmapStage DsHeatmapStage;
+
+/* Returns NULL if the group is missing, 'enable' is not set or 'classes'
+ * has no valid class id. Frames are 'frame_width' x 'frame_height', the
+ * muxer output resolution. */
+DsHeatmapStage *ds_heatmap_stage_new (const gchar * cfg_file_path,
+    const gchar * group, guint num_sources, guint frame_width,
+    guint frame_height);
+
+/* Installs the accumulation probe on the src pad of 'element'. */
+gboolean ds_heatmap_stage_attach (DsHeatmapStage * stage,
+    GstElement * element);
+
+/* Stops the writer thread, writing a last snapshot first. */
+void ds_heatmap_stage_free (DsHeatmapStage * stage);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* CPU benchmark of the re-identification index with synthetic embeddings.
+ *
+ * Builds 'identities' random unit vectors and stores 'vectors' noisy views of
+ * them, spread over 4 sources and one minute of timestamps, and trains the
+ * index on all of them. Then queries new
+ * noisy views of random identities and reports latency percentiles and how
+ * often the approximate answer equals the exhaustive one.
+ *
+ *   $ make ds-reid-bench
+ *   $ ./ds-reid-bench [vectors] [dim] [nlist] [nprobe] [identities]
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "ds_reid_index.h"
+
+#define NUM_SOURCES 4
+#define NUM_QUERIES 2000
+#define NOISE 0.35f
+#define WINDOW_USEC (60 * G_USEC_PER_SEC)
+
+static void
+noisy_view (GRand * rand, const gfloat * center, gfloat * out, guint dim)
+{
+  guint d;
+
+  for (d = 0; d < dim; d++)
+    out[d] = center[d] + NOISE * sqrtf (12.0f / dim) *
+        (gfloat) (g_rand_double (rand) - 0.5);
+  ds_reid_normalize (out, dim);
+}
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+  return (x > y) - (x < y);
+}
+
+int
+main (int argc, char *argv[])
+{
+  guint num_vectors = argc > 1 ? atoi (argv[1]) : 50000;
+  guint dim = argc > 2 ? atoi (argv[2]) : 256;
+  guint nlist = argc > 3 ? atoi (argv[3]) : 128;
+  guint nprobe = argc > 4 ? atoi (argv[4]) : 8;
+  guint identities = argc > 5 ? atoi (argv[5]) : 5000;
+  GRand *rand = g_rand_new_with_seed (42);
+  gfloat *centers, *stored, *query;
+  guint *stored_source, *stored_id;
+  gint64 *stored_time, *latencies;
+  DsReidIndex *index;
+  guint i, d, agree = 0, correct = 0;
+  gint64 start, elapsed;
+  gdouble mean = 0.0;
+
+  centers = g_new (gfloat, (gsize) identities * dim);
+  stored = g_new (gfloat, (gsize) num_vectors * dim);
+  stored_source = g_new (guint, num_vectors);
+  stored_id = g_new (guint, num_vectors);
+  stored_time = g_new (gint64, num_vectors);
+  query = g_new (gfloat, dim);
+  latencies = g_new (gint64, NUM_QUERIES);
+
+  for (i = 0; i < identities; i++) {
+    gfloat *c = centers + (gsize) i * dim;
+    for (d = 0; d < dim; d++)
+      c[d] = (gfloat) g_rand_double (rand) - 0.5f;
+    ds_reid_normalize (c, dim);
+  }
+
+  index = ds_reid_index_new (dim, num_vectors, nlist, nprobe);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < num_vectors; i++) {
+    guint id = g_rand_int_range (rand, 0, identities);
+    gfloat *v = stored + (gsize) i * dim;
+
+    noisy_view (rand, centers + (gsize) id * dim, v, dim);
+    stored_id[i] = id;
+    stored_source[i] = g_rand_int_range (rand, 0, NUM_SOURCES);
+    stored_time[i] = g_rand_int_range (rand, 0, WINDOW_USEC);
+    ds_reid_index_add (index, v, stored_source[i], id, stored_time[i]);
+  }
+  elapsed = g_get_monotonic_time () - start;
+  g_print ("Inserted %u vectors of dim %u in %.1f ms\n",
+      ds_reid_index_size (index), dim, elapsed / 1000.0);
+
+  start = g_get_monotonic_time ();
+  ds_reid_index_train (index);
+  elapsed = g_get_monotonic_time () - start;
+  g_print ("Trained %u lists in %.1f ms, probing %u per query\n", nlist,
+      elapsed / 1000.0, nprobe);
+
+  for (i = 0; i < NUM_QUERIES; i++) {
+    guint id = g_rand_int_range (rand, 0, identities);
+    guint source = g_rand_int_range (rand, 0, NUM_SOURCES);
+    gint64 not_before = WINDOW_USEC / 4;
+    DsReidMatch match;
+    gboolean ok;
+    gfloat best_sim = -G_MAXFLOAT;
+    guint best = 0, j;
+
+    noisy_view (rand, centers + (gsize) id * dim, query, dim);
+
+    start = g_get_monotonic_time ();
+    ok = ds_reid_index_search (index, query, source, not_before, &match);
+    latencies[i] = g_get_monotonic_time () - start;
+    mean += latencies[i];
+
+    /* Exhaustive reference with the same filters */
+    for (j = 0; j < num_vectors; j++) {
+      gfloat sim;
+      if (stored_source[j] == source || stored_time[j] < not_before)
+        continue;
+      sim = ds_reid_dot (query, stored + (gsize) j * dim, dim);
+      if (sim > best_sim) {
+        best_sim = sim;
+        best = j;
+      }
+    }
+    if (ok && match.global_id == stored_id[best])
+      agree++;
+    if (ok && match.global_id == id)
+      correct++;
+  }
+
+  qsort (latencies, NUM_QUERIES, sizeof (gint64), compare_gint64);
+  g_print ("Queries: %u, same identity as exhaustive %.1f%%, "
+      "true identity %.1f%%\n", NUM_QUERIES, 100.0 * agree / NUM_QUERIES,
+      100.0 * correct / NUM_QUERIES);
+  g_print ("Latency usec: mean %.1f p50 %" G_GINT64_FORMAT " p99 %"
+      G_GINT64_FORMAT " max %" G_GINT64_FORMAT "\n", mean / NUM_QUERIES,
+      latencies[NUM_QUERIES / 2], latencies[NUM_QUERIES * 99 / 100],
+      latencies[NUM_QUERIES - 1]);
+
+  ds_reid_index_free (index);
+  g_rand_free (rand);
+  g_free (centers);
+  g_free (stored);
+  g_free (stored_source);
+  g_free (stored_id);
+  g_free (stored_time);
+  g_free (query);
+  g_free (latencies);
+  return 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Randomized consistency check of the re-identification index and of the
+ * track table against brute force references.
+ *
+ * Runs random add / remove / expire / search sequences on a small index,
+ * retraining it now and then and searching while the vectors are only
+ * partially rebalanced. Every bucket is probed, so every search must return
+ * the exhaustive answer. The track table gets random get / lookup / sweep
+ * sequences on a nearly full table, which exercises backward shift deletion.
+ *
+ *   $ make check
+ *   $ ./ds-reid-check [seed] [steps]
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds_reid_index.h"
+#include "ds_track_table.h"
+
+#define DIM 12
+#define CAPACITY 700
+#define NLIST 8
+#define NUM_SOURCES 3
+
+#define MAX_TRACKS 48
+#define MAX_TRACK_AGE 6
+#define NUM_OBJECTS 80
+
+#define CHECK(cond) G_STMT_START { \
+    if (!(cond)) { \
+      g_printerr ("%s:%d: check failed at step %u: %s\n", __FILE__, \
+          __LINE__, step, #cond); \
+      return FALSE; \
+    } \
+  } G_STMT_END
+
+typedef struct
+{
+  gboolean used;
+  gint64 handle;
+  gfloat vector[DIM];
+  guint source_id;
+  gint64 timestamp;
+} RefVector;
+
+typedef struct
+{
+  gboolean used;
+  guint64 last_seen;
+} RefTrack;
+
+typedef struct
+{
+  guint source_id;
+  guint64 object_id;
+  guint64 hits;
+} TrackValue;
+
+static void
+random_vector (GRand * rand, gfloat * vector)
+{
+  guint d;
+
+  for (d = 0; d < DIM; d++)
+    vector[d] = (gfloat) g_rand_double (rand) - 0.5f;
+  ds_reid_normalize (vector, DIM);
+}
+
+/* Stored vectors are normalized copies, the reference keeps the same. */
+static gboolean
+check_search (DsReidIndex * index, RefVector * ref, GRand * rand, gint64 now,
+    guint step)
+{
+  gfloat query[DIM];
+  guint exclude = g_rand_int_range (rand, 0, NUM_SOURCES + 1);
+  gint64 not_before = now - g_rand_int_range (rand, 0, 400);
+  gfloat best_sim = -G_MAXFLOAT;
+  gint best = -1;
+  DsReidMatch match;
+  gboolean found;
+  guint i;
+
+  random_vector (rand, query);
+  found = ds_reid_index_search (index, query, exclude, not_before, &match);
+
+  for (i = 0; i < CAPACITY; i++) {
+    gfloat sim;
+
+    if (!ref[i].used || ref[i].source_id == exclude ||
+        ref[i].timestamp < not_before)
+      continue;
+    sim = ds_reid_dot (query, ref[i].vector, DIM);
+    if (sim > best_sim) {
+      best_sim = sim;
+      best = i;
+    }
+  }
+
+  CHECK (found == (best >= 0));
+  if (found) {
+    CHECK (ABS (match.similarity - best_sim) < 1e-5f);
+    /* Global ids are the reference slots, ties aside they must agree */
+    CHECK (match.global_id == (guint64) best ||
+        ABS (ds_reid_dot (query, ref[match.global_id].vector, DIM) -
+            best_sim) < 1e-5f);
+    CHECK (ref[match.global_id].used);
+    CHECK (match.source_id == ref[match.global_id].source_id);
+    CHECK (match.timestamp == ref[match.global_id].timestamp);
+  }
+  return TRUE;
+}
+
+static void
+train (DsReidIndex * index, GRand * rand)
+{
+  guint n = MIN (ds_reid_index_size (index),
+      NLIST * DS_REID_TRAIN_SAMPLES_PER_LIST);
+  gfloat *samples = g_new (gfloat, (gsize) n * DIM);
+  gfloat *centroids = g_new (gfloat, NLIST * DIM);
+
+  n = ds_reid_index_sample (index, samples, n);
+  ds_reid_kmeans (samples, n, DIM, NLIST, centroids);
+  ds_reid_index_set_centroids (index, centroids);
+  g_free (samples);
+  g_free (centroids);
+}
+
+static gboolean
+check_index (guint32 seed, guint steps)
+{
+  GRand *rand = g_rand_new_with_seed (seed);
+  DsReidIndex *index = ds_reid_index_new (DIM, CAPACITY, NLIST, NLIST);
+  RefVector *ref = g_new0 (RefVector, CAPACITY);
+  gint64 *dead = g_new0 (gint64, CAPACITY);
+  guint num_dead = 0, size = 0, trainings = 0, left = 0;
+  gint64 now = 1000;
+  guint step, i;
+
+  for (step = 0; step < steps; step++) {
+    guint op = g_rand_int_range (rand, 0, 100);
+
+    now += g_rand_int_range (rand, 0, 3);
+
+    if (op < 50) {
+      /* Add, the reference slot doubles as the global id */
+      gfloat vector[DIM];
+      guint source = g_rand_int_range (rand, 0, NUM_SOURCES);
+      gint64 handle;
+
+      for (i = 0; i < CAPACITY && ref[i].used; i++);
+      random_vector (rand, vector);
+      handle = ds_reid_index_add (index, vector, source, i, now);
+      if (size == CAPACITY) {
+        CHECK (handle == DS_REID_INVALID_HANDLE);
+        continue;
+      }
+      CHECK (handle != DS_REID_INVALID_HANDLE);
+      ref[i].used = TRUE;
+      ref[i].handle = handle;
+      memcpy (ref[i].vector, vector, sizeof (vector));
+      ref[i].source_id = source;
+      ref[i].timestamp = now;
+      size++;
+    } else if (op < 65 && size > 0) {
+      /* Remove a live vector */
+      do
+        i = g_rand_int_range (rand, 0, CAPACITY);
+      while (!ref[i].used);
+      ds_reid_index_remove (index, ref[i].handle);
+      ref[i].used = FALSE;
+      dead[num_dead++ % CAPACITY] = ref[i].handle;
+      size--;
+    } else if (op < 70 && num_dead > 0) {
+      /* Removing a stale handle must not touch the slot's new owner */
+      ds_reid_index_remove (index,
+          dead[g_rand_int_range (rand, 0, MIN (num_dead, CAPACITY))]);
+    } else if (op < 73) {
+      /* Partial expire then a full pass, together they free the same */
+      gint64 not_before = now - g_rand_int_range (rand, 100, 800);
+      guint expired, expected = 0;
+
+      expired = ds_reid_index_expire (index, not_before,
+          g_rand_int_range (rand, 1, 2 * NLIST + 1));
+      expired += ds_reid_index_expire (index, not_before, G_MAXUINT);
+      for (i = 0; i < CAPACITY; i++) {
+        if (ref[i].used && ref[i].timestamp < not_before) {
+          ref[i].used = FALSE;
+          dead[num_dead++ % CAPACITY] = ref[i].handle;
+          expected++;
+        }
+      }
+      CHECK (expired == expected);
+      size -= expected;
+    } else if (op < 75 && size >= NLIST) {
+      /* Retrain, sometimes before the last one was fully rebalanced */
+      train (index, rand);
+      trainings++;
+    } else if (op < 95) {
+      if (!check_search (index, ref, rand, now, step))
+        return FALSE;
+    }
+
+    CHECK (ds_reid_index_size (index) == size);
+    left = ds_reid_index_rebalance (index, g_rand_int_range (rand, 0, 6));
+    CHECK (left <= size);
+  }
+
+  /* Every remaining handle is still valid */
+  for (i = 0; i < CAPACITY; i++) {
+    if (ref[i].used) {
+      ds_reid_index_remove (index, ref[i].handle);
+      size--;
+      CHECK (ds_reid_index_size (index) == size);
+    }
+  }
+  CHECK (size == 0);
+
+  g_print ("Index: %u steps, %u trainings, ok\n", steps, trainings);
+  ds_reid_index_free (index);
+  g_rand_free (rand);
+  g_free (ref);
+  g_free (dead);
+  return TRUE;
+}
+
+static gboolean
+check_track_table (guint32 seed, guint steps)
+{
+  GRand *rand = g_rand_new_with_seed (seed);
+  DsTrackTable *table = ds_track_table_new (MAX_TRACKS, sizeof (TrackValue),
+      MAX_TRACK_AGE);
+  RefTrack ref[NUM_SOURCES][NUM_OBJECTS];
+  guint64 now = 1;
+  guint step, s, o, live;
+
+  memset (ref, 0, sizeof (ref));
+
+  for (step = 0; step < steps; step++) {
+    guint op = g_rand_int_range (rand, 0, 100);
+    guint source = g_rand_int_range (rand, 0, NUM_SOURCES);
+    guint64 object = g_rand_int_range (rand, 0, NUM_OBJECTS);
+    RefTrack *r = &ref[source][object];
+    gboolean alive = r->used && !(now > r->last_seen &&
+        now - r->last_seen > MAX_TRACK_AGE);
+    TrackValue *value;
+    gboolean created;
+
+    if (op < 60) {
+      value = ds_track_table_get (table, source, object, now, &created);
+      if (!value) {
+        /* Only a full table refuses a track, expired ones still count */
+        CHECK (!alive);
+        CHECK (ds_track_table_size (table) == MAX_TRACKS);
+        continue;
+      }
+      CHECK (created == !alive);
+      if (created) {
+        CHECK (value->source_id == 0 && value->object_id == 0 &&
+            value->hits == 0);
+        value->source_id = source;
+        value->object_id = object;
+      }
+      CHECK (value->source_id == source && value->object_id == object);
+      value->hits++;
+      r->used = TRUE;
+      r->last_seen = now;
+    } else if (op < 80) {
+      value = ds_track_table_lookup (table, source, object, now);
+      CHECK ((value != NULL) == alive);
+      if (value)
+        CHECK (value->source_id == source && value->object_id == object);
+    } else {
+      ds_track_table_sweep (table, now);
+      if (g_rand_int_range (rand, 0, 4) == 0)
+        now++;
+    }
+
+    /* Live tracks are all there, expired ones may still wait for a sweep */
+    live = 0;
+    for (s = 0; s < NUM_SOURCES; s++) {
+      for (o = 0; o < NUM_OBJECTS; o++) {
+        RefTrack *t = &ref[s][o];
+        if (t->used && !(now > t->last_seen &&
+                now - t->last_seen > MAX_TRACK_AGE)) {
+          value = ds_track_table_lookup (table, s, o, now);
+          CHECK (value && value->source_id == s && value->object_id == o);
+          live++;
+        }
+      }
+    }
+    CHECK (ds_track_table_size (table) >= live);
+
+    /* A sweep per 'now' for max-age steps covers the whole table */
+    if (step % 500 == 499) {
+      for (o = 0; o <= MAX_TRACK_AGE; o++)
+        ds_track_table_sweep (table, now);
+      CHECK (ds_track_table_size (table) == live);
+    }
+  }
+
+  g_print ("Track table: %u steps, ok\n", steps);
+  ds_track_table_free (table);
+  g_rand_free (rand);
+  return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  guint32 seed = argc > 1 ? atoi (argv[1]) : 42;
+  guint steps = argc > 2 ? atoi (argv[2]) : 20000;
+
+  if (!check_index (seed, steps) || !check_track_table (seed, steps))
+    return 1;
+  return 0;
+}
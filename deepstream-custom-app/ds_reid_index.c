@@ -0,0 +1,762 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+/* The AVX2/FMA kernel is compiled for its own function only and picked at
+ * run time, the rest of the binary keeps the baseline x86-64 instruction
+ * set. NEON is baseline on aarch64 (Jetson). */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DS_REID_DOT_AVX2 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "ds_reid_index.h"
+
+/* Vectors per block. Buckets grow and shrink one block at a time. */
+#define BLOCK_VECTORS 32
+
+#define KMEANS_ITERATIONS 6
+
+typedef struct
+{
+  gint next;
+  gint prev;
+  guint count;
+  guint slot[BLOCK_VECTORS];
+  guint source_id[BLOCK_VECTORS];
+  guint64 global_id[BLOCK_VECTORS];
+  gint64 timestamp[BLOCK_VECTORS];
+} DsReidBlock;
+
+typedef struct
+{
+  gint head;
+  gint tail;
+  guint count;
+} DsReidList;
+
+/* Where the vector behind a handle currently lives. Removals move vectors
+ * around inside a bucket, handles stay valid through this indirection. */
+typedef struct
+{
+  gboolean used;
+  guint32 generation;
+  guint list;
+  gint block;
+  guint pos;
+} DsReidSlot;
+
+/* Buckets come in two banks of 'nlist', each with its own centroids, plus the
+ * pending bucket. New vectors go to the current bank; after a retraining the
+ * other bank holds the vectors bucketed with the previous centroids until
+ * ds_reid_index_rebalance () has moved them over. */
+struct _DsReidIndex
+{
+  guint dim;
+  guint stride;
+  guint capacity;
+  guint nlist;
+  guint nprobe;
+  guint num_lists;
+  guint pending;
+  guint bank;
+  guint bank_size[2];
+  gboolean trained;
+  guint size;
+  guint expire_cursor;
+  guint rebalance_cursor;
+
+  gfloat *centroids;
+  gfloat *vectors;
+  gfloat *query;
+  DsReidBlock *blocks;
+  guint num_blocks;
+  gint free_block;
+  DsReidList *lists;
+  DsReidSlot *slots;
+  guint *free_slots;
+  guint num_free_slots;
+  guint *probe_lists;
+  gfloat *probe_sims;
+};
+
+static gfloat
+dot_tail (const gfloat * a, const gfloat * b, guint i, guint dim, gfloat sum)
+{
+  for (; i < dim; i++)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+#ifdef DS_REID_DOT_AVX2
+__attribute__ ((target ("avx2,fma")))
+static gfloat
+dot_avx2 (const gfloat * a, const gfloat * b, guint dim)
+{
+  __m256 acc0 = _mm256_setzero_ps ();
+  __m256 acc1 = _mm256_setzero_ps ();
+  __m128 lo, hi;
+  guint i = 0;
+
+  for (; i + 16 <= dim; i += 16) {
+    acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (a + i), _mm256_loadu_ps (b + i),
+        acc0);
+    acc1 = _mm256_fmadd_ps (_mm256_loadu_ps (a + i + 8),
+        _mm256_loadu_ps (b + i + 8), acc1);
+  }
+  for (; i + 8 <= dim; i += 8)
+    acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (a + i), _mm256_loadu_ps (b + i),
+        acc0);
+  acc0 = _mm256_add_ps (acc0, acc1);
+  lo = _mm_add_ps (_mm256_castps256_ps128 (acc0),
+      _mm256_extractf128_ps (acc0, 1));
+  lo = _mm_hadd_ps (lo, lo);
+  hi = _mm_hadd_ps (lo, lo);
+  return dot_tail (a, b, i, dim, _mm_cvtss_f32 (hi));
+}
+#endif
+
+gfloat
+ds_reid_dot (const gfloat * a, const gfloat * b, guint dim)
+{
+  guint i = 0;
+
+#ifdef DS_REID_DOT_AVX2
+  static gint use_avx2 = -1;
+
+  if (G_UNLIKELY (use_avx2 < 0))
+    use_avx2 = __builtin_cpu_supports ("avx2") &&
+        __builtin_cpu_supports ("fma");
+  if (use_avx2)
+    return dot_avx2 (a, b, dim);
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  float32x4_t acc0 = vdupq_n_f32 (0.0f);
+  float32x4_t acc1 = vdupq_n_f32 (0.0f);
+
+  for (; i + 8 <= dim; i += 8) {
+    acc0 = vfmaq_f32 (acc0, vld1q_f32 (a + i), vld1q_f32 (b + i));
+    acc1 = vfmaq_f32 (acc1, vld1q_f32 (a + i + 4), vld1q_f32 (b + i + 4));
+  }
+  return dot_tail (a, b, i, dim, vaddvq_f32 (vaddq_f32 (acc0, acc1)));
+#else
+  gfloat acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+  for (; i + 4 <= dim; i += 4) {
+    acc[0] += a[i] * b[i];
+    acc[1] += a[i + 1] * b[i + 1];
+    acc[2] += a[i + 2] * b[i + 2];
+    acc[3] += a[i + 3] * b[i + 3];
+  }
+  return dot_tail (a, b, i, dim, (acc[0] + acc[1]) + (acc[2] + acc[3]));
+#endif
+}
+
+void
+ds_reid_normalize (gfloat * vector, guint dim)
+{
+  gfloat norm = sqrtf (ds_reid_dot (vector, vector, dim));
+  guint i;
+
+  if (norm < 1e-12f)
+    return;
+  for (i = 0; i < dim; i++)
+    vector[i] /= norm;
+}
+
+static inline gfloat *
+block_vector (DsReidIndex * index, gint block, guint pos)
+{
+  return index->vectors +
+      ((gsize) block * BLOCK_VECTORS + pos) * index->stride;
+}
+
+static inline gfloat *
+bank_centroids (DsReidIndex * index, guint bank)
+{
+  return index->centroids + (gsize) bank * index->nlist * index->stride;
+}
+
+static gint
+alloc_block (DsReidIndex * index)
+{
+  gint block = index->free_block;
+
+  if (block >= 0) {
+    index->free_block = index->blocks[block].next;
+    index->blocks[block].count = 0;
+    index->blocks[block].next = -1;
+    index->blocks[block].prev = -1;
+  }
+  return block;
+}
+
+static void
+reset_lists (DsReidIndex * index)
+{
+  guint i;
+
+  for (i = 0; i < index->num_blocks; i++)
+    index->blocks[i].next = (i + 1 < index->num_blocks) ? (gint) i + 1 : -1;
+  index->free_block = 0;
+
+  for (i = 0; i < index->num_lists; i++) {
+    index->lists[i].head = -1;
+    index->lists[i].tail = -1;
+    index->lists[i].count = 0;
+  }
+}
+
+/* Copies a stride long, zero padded vector to the end of bucket 'list'. */
+static void
+list_append (DsReidIndex * index, guint list, const gfloat * vector,
+    guint slot, guint source_id, guint64 global_id, gint64 timestamp)
+{
+  DsReidList *l = &index->lists[list];
+  DsReidBlock *blk;
+  guint pos;
+
+  if (l->tail < 0 || index->blocks[l->tail].count == BLOCK_VECTORS) {
+    /* The pool is sized so that this cannot fail, see ds_reid_index_new */
+    gint block = alloc_block (index);
+    index->blocks[block].prev = l->tail;
+    if (l->tail >= 0)
+      index->blocks[l->tail].next = block;
+    else
+      l->head = block;
+    l->tail = block;
+  }
+
+  blk = &index->blocks[l->tail];
+  pos = blk->count++;
+  memcpy (block_vector (index, l->tail, pos), vector,
+      index->stride * sizeof (gfloat));
+  blk->slot[pos] = slot;
+  blk->source_id[pos] = source_id;
+  blk->global_id[pos] = global_id;
+  blk->timestamp[pos] = timestamp;
+  l->count++;
+  if (list != index->pending)
+    index->bank_size[list / index->nlist]++;
+
+  index->slots[slot].list = list;
+  index->slots[slot].block = l->tail;
+  index->slots[slot].pos = pos;
+}
+
+/* Moves the last vector of the bucket into the hole at (block, pos). */
+static void
+list_remove_at (DsReidIndex * index, guint list, gint block, guint pos)
+{
+  DsReidList *l = &index->lists[list];
+  DsReidBlock *tail = &index->blocks[l->tail];
+  DsReidBlock *blk = &index->blocks[block];
+  guint last = tail->count - 1;
+
+  if (block != l->tail || pos != last) {
+    guint moved = tail->slot[last];
+
+    memcpy (block_vector (index, block, pos),
+        block_vector (index, l->tail, last), index->stride * sizeof (gfloat));
+    blk->slot[pos] = moved;
+    blk->source_id[pos] = tail->source_id[last];
+    blk->global_id[pos] = tail->global_id[last];
+    blk->timestamp[pos] = tail->timestamp[last];
+    index->slots[moved].block = block;
+    index->slots[moved].pos = pos;
+  }
+
+  tail->count--;
+  l->count--;
+  if (list != index->pending)
+    index->bank_size[list / index->nlist]--;
+  if (tail->count == 0) {
+    gint freed = l->tail;
+
+    l->tail = tail->prev;
+    if (l->tail >= 0)
+      index->blocks[l->tail].next = -1;
+    else
+      l->head = -1;
+    tail->next = index->free_block;
+    index->free_block = freed;
+  }
+}
+
+static void
+release_slot (DsReidIndex * index, guint slot)
+{
+  index->slots[slot].used = FALSE;
+  index->slots[slot].generation++;
+  index->free_slots[index->num_free_slots++] = slot;
+  index->size--;
+}
+
+static guint
+nearest_centroid (const gfloat * centroids, guint k, guint stride,
+    const gfloat * vector)
+{
+  gfloat best_sim = -G_MAXFLOAT;
+  guint i, best = 0;
+
+  for (i = 0; i < k; i++) {
+    gfloat sim = ds_reid_dot (vector, centroids + (gsize) i * stride, stride);
+    if (sim > best_sim) {
+      best_sim = sim;
+      best = i;
+    }
+  }
+  return best;
+}
+
+/* Bucket for a new vector, the pending bucket until centroids exist. */
+static guint
+target_list (DsReidIndex * index, const gfloat * vector)
+{
+  if (!index->trained)
+    return index->pending;
+  return index->bank * index->nlist +
+      nearest_centroid (bank_centroids (index, index->bank), index->nlist,
+      index->stride, vector);
+}
+
+/* Fills 'lists' with the 'nprobe' buckets of 'bank' closest to 'vector'. */
+static guint
+select_probe_lists (DsReidIndex * index, const gfloat * vector, guint bank,
+    guint * lists)
+{
+  const gfloat *centroids = bank_centroids (index, bank);
+  guint nprobe = MIN (index->nprobe, index->nlist);
+  guint i, count = 0;
+
+  for (i = 0; i < index->nlist; i++) {
+    guint list = bank * index->nlist + i;
+    gfloat sim;
+    guint j;
+
+    if (index->lists[list].count == 0)
+      continue;
+    sim = ds_reid_dot (vector, centroids + (gsize) i * index->stride,
+        index->stride);
+    if (count == nprobe && sim <= index->probe_sims[count - 1])
+      continue;
+
+    /* Insertion into the short sorted candidate array */
+    j = (count < nprobe) ? count++ : count - 1;
+    while (j > 0 && index->probe_sims[j - 1] < sim) {
+      index->probe_sims[j] = index->probe_sims[j - 1];
+      lists[j] = lists[j - 1];
+      j--;
+    }
+    index->probe_sims[j] = sim;
+    lists[j] = list;
+  }
+  return count;
+}
+
+/* Moves the last vector of bucket 'from' to the bucket it belongs to now. */
+static void
+move_tail (DsReidIndex * index, guint from)
+{
+  DsReidList *l = &index->lists[from];
+  DsReidBlock *blk = &index->blocks[l->tail];
+  guint pos = blk->count - 1;
+  const gfloat *v = block_vector (index, l->tail, pos);
+
+  /* Taking the tail makes the removal a plain pop */
+  list_append (index, target_list (index, v), v, blk->slot[pos],
+      blk->source_id[pos], blk->global_id[pos], blk->timestamp[pos]);
+  list_remove_at (index, from, l->tail, pos);
+}
+
+DsReidIndex *
+ds_reid_index_new (guint dim, guint capacity, guint nlist, guint nprobe)
+{
+  DsReidIndex *index;
+  guint i;
+
+  g_return_val_if_fail (dim > 0 && capacity > 0, NULL);
+
+  index = g_new0 (DsReidIndex, 1);
+  index->dim = dim;
+  index->stride = (dim + 7) & ~7u;
+  index->capacity = capacity;
+  index->nlist = MAX (nlist, 1);
+  index->nprobe = MAX (nprobe, 1);
+  index->num_lists = 2 * index->nlist + 1;
+  index->pending = 2 * index->nlist;
+
+  /* Every bucket, including the pending one, wastes less than one block.
+   * One more covers a vector being moved between buckets. */
+  index->num_blocks = (capacity + BLOCK_VECTORS - 1) / BLOCK_VECTORS +
+      index->num_lists + 1;
+  index->blocks = g_new0 (DsReidBlock, index->num_blocks);
+  index->vectors = g_new0 (gfloat,
+      (gsize) index->num_blocks * BLOCK_VECTORS * index->stride);
+  index->centroids = g_new0 (gfloat,
+      (gsize) 2 * index->nlist * index->stride);
+  index->query = g_new0 (gfloat, index->stride);
+  index->lists = g_new0 (DsReidList, index->num_lists);
+  index->slots = g_new0 (DsReidSlot, capacity);
+  index->free_slots = g_new0 (guint, capacity);
+  index->probe_lists = g_new0 (guint, 2 * index->nprobe + 1);
+  index->probe_sims = g_new0 (gfloat, index->nprobe);
+
+  for (i = 0; i < capacity; i++)
+    index->free_slots[i] = capacity - 1 - i;
+  index->num_free_slots = capacity;
+  reset_lists (index);
+  return index;
+}
+
+void
+ds_reid_index_free (DsReidIndex * index)
+{
+  if (!index)
+    return;
+  g_free (index->blocks);
+  g_free (index->vectors);
+  g_free (index->centroids);
+  g_free (index->query);
+  g_free (index->lists);
+  g_free (index->slots);
+  g_free (index->free_slots);
+  g_free (index->probe_lists);
+  g_free (index->probe_sims);
+  g_free (index);
+}
+
+gint64
+ds_reid_index_add (DsReidIndex * index, gfloat * vector, guint source_id,
+    guint64 global_id, gint64 timestamp)
+{
+  guint slot;
+
+  if (index->num_free_slots == 0)
+    return DS_REID_INVALID_HANDLE;
+
+  ds_reid_normalize (vector, index->dim);
+  memcpy (index->query, vector, index->dim * sizeof (gfloat));
+
+  slot = index->free_slots[--index->num_free_slots];
+  index->slots[slot].used = TRUE;
+  list_append (index, target_list (index, index->query), index->query, slot,
+      source_id, global_id, timestamp);
+  index->size++;
+
+  return ((gint64) (index->slots[slot].generation & 0x7fffffff) << 32) | slot;
+}
+
+void
+ds_reid_index_remove (DsReidIndex * index, gint64 handle)
+{
+  guint slot = (guint) (handle & 0xffffffff);
+  DsReidSlot *s;
+
+  if (handle < 0 || slot >= index->capacity)
+    return;
+  s = &index->slots[slot];
+  if (!s->used || (s->generation & 0x7fffffff) != (guint32) (handle >> 32))
+    return;
+
+  list_remove_at (index, s->list, s->block, s->pos);
+  release_slot (index, slot);
+}
+
+gboolean
+ds_reid_index_search (DsReidIndex * index, const gfloat * vector,
+    guint exclude_source, gint64 not_before, DsReidMatch * match)
+{
+  gfloat best_sim = -G_MAXFLOAT;
+  gboolean found = FALSE;
+  guint nprobe, p;
+
+  memcpy (index->query, vector, index->dim * sizeof (gfloat));
+  nprobe = 0;
+  if (index->trained)
+    nprobe = select_probe_lists (index, index->query, index->bank,
+        index->probe_lists);
+  /* Buckets of the previous centroids until they are rebalanced */
+  if (index->bank_size[index->bank ^ 1] > 0)
+    nprobe += select_probe_lists (index, index->query, index->bank ^ 1,
+        index->probe_lists + nprobe);
+
+  /* The pending bucket is always scanned in full */
+  index->probe_lists[nprobe++] = index->pending;
+
+  for (p = 0; p < nprobe; p++) {
+    gint block;
+
+    for (block = index->lists[index->probe_lists[p]].head; block >= 0;
+        block = index->blocks[block].next) {
+      DsReidBlock *blk = &index->blocks[block];
+      const gfloat *vec = block_vector (index, block, 0);
+      guint pos;
+
+      for (pos = 0; pos < blk->count; pos++, vec += index->stride) {
+        gfloat sim;
+
+        if (blk->source_id[pos] == exclude_source ||
+            blk->timestamp[pos] < not_before)
+          continue;
+        sim = ds_reid_dot (index->query, vec, index->stride);
+        if (sim > best_sim) {
+          best_sim = sim;
+          match->global_id = blk->global_id[pos];
+          match->source_id = blk->source_id[pos];
+          match->timestamp = blk->timestamp[pos];
+          match->similarity = sim;
+          found = TRUE;
+        }
+      }
+    }
+  }
+  return found;
+}
+
+guint
+ds_reid_index_expire (DsReidIndex * index, gint64 not_before,
+    guint max_lists)
+{
+  guint n, expired = 0;
+
+  for (n = 0; n < max_lists && n < index->num_lists; n++) {
+    guint list = index->expire_cursor++ % index->num_lists;
+    gint block = index->lists[list].head;
+
+    while (block >= 0) {
+      DsReidBlock *blk = &index->blocks[block];
+      guint pos = 0;
+
+      while (pos < blk->count) {
+        if (blk->timestamp[pos] < not_before) {
+          guint slot = blk->slot[pos];
+          gboolean was_tail = (block == index->lists[list].tail);
+
+          /* The hole is refilled from the bucket tail, check it again */
+          list_remove_at (index, list, block, pos);
+          release_slot (index, slot);
+          expired++;
+          if (was_tail && blk->count == 0)
+            break;
+          continue;
+        }
+        pos++;
+      }
+      block = (blk->count == 0) ? -1 : blk->next;
+    }
+  }
+  return expired;
+}
+
+guint
+ds_reid_index_sample (DsReidIndex * index, gfloat * samples,
+    guint max_samples)
+{
+  guint step, i, n = 0, seen = 0, next = 0;
+
+  if (max_samples == 0)
+    return 0;
+
+  /* Every step-th vector, so the samples cover all buckets */
+  step = MAX (index->size / max_samples, 1);
+  for (i = 0; i < index->num_lists && n < max_samples; i++) {
+    gint block;
+
+    for (block = index->lists[i].head; block >= 0 && n < max_samples;
+        block = index->blocks[block].next) {
+      guint count = index->blocks[block].count;
+
+      for (; next < seen + count && n < max_samples; next += step, n++)
+        memcpy (samples + (gsize) n * index->dim,
+            block_vector (index, block, next - seen),
+            index->dim * sizeof (gfloat));
+      seen += count;
+    }
+  }
+  return n;
+}
+
+void
+ds_reid_kmeans (const gfloat * samples, guint n, guint dim, guint k,
+    gfloat * centroids)
+{
+  gfloat *sums;
+  guint *counts;
+  guint i, c, iter;
+
+  g_return_if_fail (n >= k && k > 0);
+
+  sums = g_new (gfloat, (gsize) k * dim);
+  counts = g_new (guint, k);
+
+  /* Spherical k-means seeded with evenly spaced samples */
+  for (c = 0; c < k; c++)
+    memcpy (centroids + (gsize) c * dim, samples + (gsize) c * (n / k) * dim,
+        dim * sizeof (gfloat));
+
+  for (iter = 0; iter < KMEANS_ITERATIONS; iter++) {
+    memset (sums, 0, (gsize) k * dim * sizeof (gfloat));
+    memset (counts, 0, k * sizeof (guint));
+    for (i = 0; i < n; i++) {
+      const gfloat *v = samples + (gsize) i * dim;
+      guint nearest = nearest_centroid (centroids, k, dim, v);
+      gfloat *sum = sums + (gsize) nearest * dim;
+      guint d;
+
+      for (d = 0; d < dim; d++)
+        sum[d] += v[d];
+      counts[nearest]++;
+    }
+    for (c = 0; c < k; c++) {
+      /* Empty clusters keep their previous centroid */
+      if (counts[c] == 0)
+        continue;
+      memcpy (centroids + (gsize) c * dim, sums + (gsize) c * dim,
+          dim * sizeof (gfloat));
+      ds_reid_normalize (centroids + (gsize) c * dim, dim);
+    }
+  }
+
+  g_free (sums);
+  g_free (counts);
+}
+
+void
+ds_reid_index_set_centroids (DsReidIndex * index, const gfloat * centroids)
+{
+  guint stale = index->bank ^ 1;
+  gfloat *bank;
+  guint c, i;
+
+  /* Leftovers of the swap before, normally rebalanced away already */
+  for (i = 0; i < index->nlist; i++) {
+    DsReidList *l = &index->lists[stale * index->nlist + i];
+    while (l->count > 0) {
+      DsReidBlock *blk = &index->blocks[l->tail];
+      guint pos = blk->count - 1;
+
+      list_append (index, index->pending, block_vector (index, l->tail, pos),
+          blk->slot[pos], blk->source_id[pos], blk->global_id[pos],
+          blk->timestamp[pos]);
+      list_remove_at (index, stale * index->nlist + i, l->tail, pos);
+    }
+  }
+
+  /* The current buckets become the stale ones and keep their centroids */
+  bank = bank_centroids (index, stale);
+  for (c = 0; c < index->nlist; c++)
+    memcpy (bank + (gsize) c * index->stride,
+        centroids + (gsize) c * index->dim, index->dim * sizeof (gfloat));
+  index->bank = stale;
+  index->rebalance_cursor = 0;
+  index->trained = TRUE;
+}
+
+guint
+ds_reid_index_rebalance (DsReidIndex * index, guint max_vectors)
+{
+  DsReidList *pending = &index->lists[index->pending];
+  guint stale = index->bank ^ 1;
+  guint n;
+
+  if (!index->trained)
+    return pending->count;
+
+  for (n = 0; n < max_vectors && pending->count > 0; n++)
+    move_tail (index, index->pending);
+
+  while (n < max_vectors && index->bank_size[stale] > 0) {
+    guint list = stale * index->nlist + index->rebalance_cursor;
+
+    if (index->lists[list].count == 0) {
+      index->rebalance_cursor = (index->rebalance_cursor + 1) % index->nlist;
+      continue;
+    }
+    move_tail (index, list);
+    n++;
+  }
+  return pending->count + index->bank_size[stale];
+}
+
+void
+ds_reid_index_train (DsReidIndex * index)
+{
+  gfloat *samples, *centroids;
+  guint n;
+
+  if (index->size < index->nlist)
+    return;
+
+  n = MIN (index->size, index->nlist * DS_REID_TRAIN_SAMPLES_PER_LIST);
+  samples = g_new (gfloat, (gsize) n * index->dim);
+  centroids = g_new (gfloat, (gsize) index->nlist * index->dim);
+  n = ds_reid_index_sample (index, samples, n);
+  ds_reid_kmeans (samples, n, index->dim, index->nlist, centroids);
+  ds_reid_index_set_centroids (index, centroids);
+  ds_reid_index_rebalance (index, G_MAXUINT);
+  g_free (samples);
+  g_free (centroids);
+}
+
+gboolean
+ds_reid_index_is_trained (DsReidIndex * index)
+{
+  return index->trained;
+}
+
+gfloat
+ds_reid_index_imbalance (DsReidIndex * index)
+{
+  guint size = index->bank_size[index->bank];
+  guint i, largest = 0;
+
+  if (!index->trained || size == 0)
+    return 0.0f;
+  for (i = 0; i < index->nlist; i++)
+    largest = MAX (largest,
+        index->lists[index->bank * index->nlist + i].count);
+  return (gfloat) largest * index->nlist / size;
+}
+
+guint
+ds_reid_index_nlist (DsReidIndex * index)
+{
+  return index->nlist;
+}
+
+guint
+ds_reid_index_size (DsReidIndex * index)
+{
+  return index->size;
+}
+
+guint
+ds_reid_index_dim (DsReidIndex * index)
+{
+  return index->dim;
+}
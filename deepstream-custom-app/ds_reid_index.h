@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __DS_REID_INDEX_H__
+#define __DS_REID_INDEX_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* In-memory approximate nearest neighbor index for appearance embeddings.
+ *
+ * Inverted file (IVF) layout: vectors are bucketed by their closest coarse
+ * centroid and a query only scans the 'nprobe' buckets whose centroids are
+ * the most similar to it. Buckets are chains of fixed size blocks carved out
+ * of one pool, so vectors of a bucket are contiguous and the scan is a
+ * stream of SIMD dot products (AVX2/FMA on x86, NEON on Jetson).
+ *
+ * Vectors added before the centroids exist go to a pending bucket that every
+ * search scans in full. Training can be repeated as the data drifts and is
+ * split so that the expensive part can run off the streaming thread:
+ *   ds_reid_index_sample ()        copy stored vectors (under the caller lock)
+ *   ds_reid_kmeans ()              pure function, any thread
+ *   ds_reid_index_set_centroids () swaps the centroids in, under the caller
+ *                                  lock
+ *   ds_reid_index_rebalance ()     moves a bounded number of vectors into
+ *                                  their new buckets, call it every frame
+ * Until rebalanced, vectors stay in the buckets of the previous centroids,
+ * which searches probe with those centroids, so retraining never makes a
+ * search scan everything.
+ *
+ * Vectors are L2 normalized on insertion and similarity is the cosine. Each
+ * vector carries the source it came from, a global identity and a
+ * timestamp; searches skip one source and everything older than a given
+ * time, and ds_reid_index_expire () frees old vectors incrementally.
+ *
+ * All memory except the training buffers is allocated by ds_reid_index_new ().
+ * Not thread safe, callers serialize access. */
+
+typedef struct _DsReidIndex DsReidIndex;
+
+typedef struct
+{
+  guint64 global_id;
+  guint source_id;
+  gint64 timestamp;
+  gfloat similarity;
+} DsReidMatch;
+
+#define DS_REID_INVALID_HANDLE ((gint64) -1)
+
+/* Training samples per bucket that give balanced buckets. */
+#define DS_REID_TRAIN_SAMPLES_PER_LIST 64
+
+DsReidIndex *ds_reid_index_new (guint dim, guint capacity, guint nlist,
+    guint nprobe);
+
+void ds_reid_index_free (DsReidIndex * index);
+
+/* Normalizes 'vector' in place, then stores a copy. Returns a handle for
+ * ds_reid_index_remove (), or DS_REID_INVALID_HANDLE if the index is full. */
+gint64 ds_reid_index_add (DsReidIndex * index, gfloat * vector,
+    guint source_id, guint64 global_id, gint64 timestamp);
+
+/* Removing an already expired handle is a no-op. */
+void ds_reid_index_remove (DsReidIndex * index, gint64 handle);
+
+/* Finds the most similar vector whose source differs from 'exclude_source'
+ * and whose timestamp is not older than 'not_before'. 'vector' must be L2
+ * normalized. Returns FALSE if nothing qualifies. */
+gboolean ds_reid_index_search (DsReidIndex * index, const gfloat * vector,
+    guint exclude_source, gint64 not_before, DsReidMatch * match);
+
+/* Frees vectors older than 'not_before' from the next 'max_lists' buckets and
+ * returns how many were freed. */
+guint ds_reid_index_expire (DsReidIndex * index, gint64 not_before,
+    guint max_lists);
+
+/* Copies up to 'max_samples' stored vectors, 'dim' floats each, spread evenly
+ * over the index. */
+guint ds_reid_index_sample (DsReidIndex * index, gfloat * samples,
+    guint max_samples);
+
+/* Spherical k-means of 'n' normalized samples into 'k' centroids. Touches no
+ * index state, safe to run on a worker thread. */
+void ds_reid_kmeans (const gfloat * samples, guint n, guint dim, guint k,
+    gfloat * centroids);
+
+/* Installs 'nlist' centroids of 'dim' floats in O(nlist * dim). The buckets
+ * of the previous centroids stay searchable until rebalanced; vectors of the
+ * centroids before those, if still not rebalanced, are moved to the pending
+ * bucket. */
+void ds_reid_index_set_centroids (DsReidIndex * index,
+    const gfloat * centroids);
+
+/* Moves up to 'max_vectors' pending vectors, then vectors of the previous
+ * centroids, to their buckets and returns how many are left to move. Does
+ * nothing before centroids are set. */
+guint ds_reid_index_rebalance (DsReidIndex * index, guint max_vectors);
+
+/* Synchronous sample + k-means + rebalance, for benchmarks. Samples at most
+ * DS_REID_TRAIN_SAMPLES_PER_LIST vectors per bucket. */
+void ds_reid_index_train (DsReidIndex * index);
+
+gboolean ds_reid_index_is_trained (DsReidIndex * index);
+
+/* Size of the largest bucket over the mean bucket size, 1 when balanced and
+ * 0 before training. */
+gfloat ds_reid_index_imbalance (DsReidIndex * index);
+
+guint ds_reid_index_nlist (DsReidIndex * index);
+
+guint ds_reid_index_size (DsReidIndex * index);
+
+guint ds_reid_index_dim (DsReidIndex * index);
+
+/* L2 normalizes 'vector' in place. */
+void ds_reid_normalize (gfloat * vector, guint dim);
+
+/* Inner product of two 'dim' long vectors, using the SIMD kernel. */
+gfloat ds_reid_dot (const gfloat * a, const gfloat * b, guint dim);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "gstnvdsmeta.h"
+#include "gstnvdsinfer.h"
+#include "ds_custom_config.h"
+#include "ds_reid_index.h"
+#include "ds_reid_stage.h"
+#include "ds_track_table.h"
+
+/* Buckets checked for expired embeddings per frame. */
+#define EXPIRE_LISTS_PER_FRAME 2
+
+/* Embeddings moved to their bucket per frame after training. */
+#define REBALANCE_PER_FRAME 64
+
+enum
+{
+  TRAIN_IDLE,
+  TRAIN_RUNNING,
+  TRAIN_DONE,
+};
+
+/* nvinfer in secondary mode only attaches an embedding when it re-infers an
+ * object, so the latest one is kept with the track until it is used. */
+typedef struct
+{
+  guint64 global_id;
+  gint64 handle;
+  guint frames_seen;
+  guint64 embedded_at;
+  guint64 received_at;
+  gfloat embedding[];
+} DsReidTrack;
+
+struct _DsReidStage
+{
+  gchar *config_file;
+  gint reid_gie_id;
+  gboolean class_selected[DS_CFG_MAX_CLASSES];
+  guint min_track_frames;
+  guint refresh_interval;
+  gint64 match_window;
+  gfloat match_threshold;
+  guint retrain_interval;
+  gfloat retrain_imbalance;
+  guint stats_interval;
+
+  GMutex lock;
+  DsReidIndex *index;
+  DsTrackTable *tracks;
+  gfloat *embedding;
+  guint64 frame_count;
+  guint64 next_global_id;
+  gboolean dim_warned;
+
+  /* k-means runs on its own thread, see maybe_train () */
+  GThread *train_thread;
+  gint train_state;
+  gfloat *train_samples;
+  guint train_num_samples;
+  gfloat *train_centroids;
+  guint added_since_train;
+  guint rebalance_left;
+  guint64 trainings;
+
+  guint64 queries;
+  guint64 matches;
+  guint64 identities;
+  gint64 query_usec_total;
+  gint64 query_usec_max;
+  guint64 index_full;
+  guint64 overflows;
+};
+
+/* Returns the embedding the reid sgie attached to the object, if any. */
+static const gfloat *
+find_embedding (DsReidStage * stage, NvDsObjectMeta * obj_meta, guint * dim)
+{
+  NvDsMetaList *l_user;
+
+  for (l_user = obj_meta->obj_user_meta_list; l_user != NULL;
+      l_user = l_user->next) {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) l_user->data;
+    NvDsInferTensorMeta *tensor_meta;
+    NvDsInferLayerInfo *layer;
+
+    if (user_meta->base_meta.meta_type != NVDSINFER_TENSOR_OUTPUT_META)
+      continue;
+    tensor_meta = (NvDsInferTensorMeta *) user_meta->user_meta_data;
+    if (tensor_meta->unique_id != (guint) stage->reid_gie_id ||
+        tensor_meta->num_output_layers < 1)
+      continue;
+
+    layer = &tensor_meta->output_layers_info[0];
+    if (layer->dataType != FLOAT)
+      continue;
+    *dim = layer->inferDims.numElements;
+    return (const gfloat *) tensor_meta->out_buf_ptrs_host[0];
+  }
+  return NULL;
+}
+
+static gpointer
+train_thread_func (gpointer data)
+{
+  DsReidStage *stage = (DsReidStage *) data;
+
+  ds_reid_kmeans (stage->train_samples, stage->train_num_samples,
+      ds_reid_index_dim (stage->index), ds_reid_index_nlist (stage->index),
+      stage->train_centroids);
+  g_atomic_int_set (&stage->train_state, TRAIN_DONE);
+  return NULL;
+}
+
+/* The buckets drift away from the embeddings as the scenes change. Retrain
+ * after 'retrain-interval' new embeddings, or earlier once the largest
+ * bucket is 'retrain-imbalance' times the mean one. */
+static gboolean
+needs_retrain (DsReidStage * stage)
+{
+  guint nlist = ds_reid_index_nlist (stage->index);
+
+  if (stage->retrain_interval &&
+      stage->added_since_train >= stage->retrain_interval)
+    return TRUE;
+  return stage->retrain_imbalance > 0 &&
+      stage->added_since_train >= nlist * DS_REID_TRAIN_SAMPLES_PER_LIST &&
+      ds_reid_index_imbalance (stage->index) > stage->retrain_imbalance;
+}
+
+/* Trains the index buckets once enough embeddings were collected, and again
+ * when needs_retrain (). Only the sample copy and the centroid swap happen
+ * on the streaming thread, the vectors move to the new buckets a few per
+ * frame. */
+static void
+maybe_train (DsReidStage * stage)
+{
+  guint nlist = ds_reid_index_nlist (stage->index);
+  guint dim = ds_reid_index_dim (stage->index);
+
+  if (g_atomic_int_get (&stage->train_state) == TRAIN_DONE) {
+    g_thread_join (stage->train_thread);
+    stage->train_thread = NULL;
+    ds_reid_index_set_centroids (stage->index, stage->train_centroids);
+    g_clear_pointer (&stage->train_samples, g_free);
+    g_clear_pointer (&stage->train_centroids, g_free);
+    g_atomic_int_set (&stage->train_state, TRAIN_IDLE);
+    stage->trainings++;
+    return;
+  }
+
+  if (nlist < 2 || g_atomic_int_get (&stage->train_state) != TRAIN_IDLE ||
+      stage->rebalance_left > 0 ||
+      ds_reid_index_size (stage->index) <
+      nlist * DS_REID_TRAIN_SAMPLES_PER_LIST)
+    return;
+  if (ds_reid_index_is_trained (stage->index) && !needs_retrain (stage))
+    return;
+
+  stage->added_since_train = 0;
+  stage->train_num_samples = nlist * DS_REID_TRAIN_SAMPLES_PER_LIST;
+  stage->train_samples = g_new (gfloat,
+      (gsize) stage->train_num_samples * dim);
+  stage->train_centroids = g_new (gfloat, (gsize) nlist * dim);
+  stage->train_num_samples = ds_reid_index_sample (stage->index,
+      stage->train_samples, stage->train_num_samples);
+  g_atomic_int_set (&stage->train_state, TRAIN_RUNNING);
+  stage->train_thread = g_thread_new ("reid-train", train_thread_func, stage);
+}
+
+static void
+identify_track (DsReidStage * stage, DsReidTrack * track, guint source_id,
+    gint64 now)
+{
+  DsReidMatch match;
+  gboolean found;
+  gint64 start, elapsed;
+
+  start = g_get_monotonic_time ();
+  found = ds_reid_index_search (stage->index, stage->embedding, source_id,
+      now - stage->match_window, &match);
+  elapsed = g_get_monotonic_time () - start;
+
+  stage->queries++;
+  stage->query_usec_total += elapsed;
+  stage->query_usec_max = MAX (stage->query_usec_max, elapsed);
+
+  if (found && match.similarity >= stage->match_threshold) {
+    track->global_id = match.global_id;
+    stage->matches++;
+  } else {
+    track->global_id = stage->next_global_id++;
+    stage->identities++;
+  }
+}
+
+/* reid_src_pad_buffer_probe assigns global identities to the confirmed tracks
+ * of every frame and keeps their embeddings in the index. */
+static GstPadProbeReturn
+reid_src_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  DsReidStage *stage = (DsReidStage *) u_data;
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsMetaList *l_frame = NULL;
+  NvDsMetaList *l_obj = NULL;
+  guint dim = ds_reid_index_dim (stage->index);
+  gboolean print_stats;
+  gint64 now;
+
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+
+  now = g_get_monotonic_time ();
+  g_mutex_lock (&stage->lock);
+  stage->frame_count++;
+
+  for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
+
+    for (l_obj = frame_meta->obj_meta_list; l_obj != NULL;
+        l_obj = l_obj->next) {
+      NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) (l_obj->data);
+      const gfloat *embedding;
+      DsReidTrack *track;
+      gboolean created;
+      guint embedding_dim = 0;
+
+      if (!ds_cfg_class_selected (stage->class_selected, obj_meta->class_id)
+          || obj_meta->object_id == UNTRACKED_OBJECT_ID)
+        continue;
+
+      track = ds_track_table_get (stage->tracks, frame_meta->source_id,
+          obj_meta->object_id, stage->frame_count, &created);
+      if (!track) {
+        stage->overflows++;
+        continue;
+      }
+      track->frames_seen++;
+
+      embedding = find_embedding (stage, obj_meta, &embedding_dim);
+      if (embedding && embedding_dim != dim) {
+        if (!stage->dim_warned)
+          g_printerr ("WARNING: ReID embedding has %u elements, expected %u\n",
+              embedding_dim, dim);
+        stage->dim_warned = TRUE;
+        embedding = NULL;
+      }
+
+      if (embedding) {
+        memcpy (track->embedding, embedding, dim * sizeof (gfloat));
+        track->received_at = stage->frame_count;
+      }
+
+      /* Identify once the track is confirmed, then store each new embedding
+       * every refresh-interval frames */
+      if (track->received_at > track->embedded_at &&
+          (track->global_id == 0 ?
+              track->frames_seen >= stage->min_track_frames :
+              stage->frame_count - track->embedded_at >=
+              stage->refresh_interval)) {
+        memcpy (stage->embedding, track->embedding, dim * sizeof (gfloat));
+        ds_reid_normalize (stage->embedding, dim);
+
+        if (track->global_id == 0)
+          identify_track (stage, track, frame_meta->source_id, now);
+        else
+          ds_reid_index_remove (stage->index, track->handle);
+
+        track->handle = ds_reid_index_add (stage->index, stage->embedding,
+            frame_meta->source_id, track->global_id, now);
+        if (track->handle == DS_REID_INVALID_HANDLE)
+          stage->index_full++;
+        else
+          stage->added_since_train++;
+        track->embedded_at = stage->frame_count;
+      }
+
+      obj_meta->misc_obj_info[DS_REID_GLOBAL_ID_FIELD] =
+          (gint64) track->global_id;
+    }
+  }
+
+  /* Ended tracks stay in the index until the match window passes */
+  ds_track_table_sweep (stage->tracks, stage->frame_count);
+  ds_reid_index_expire (stage->index, now - stage->match_window,
+      EXPIRE_LISTS_PER_FRAME);
+  stage->rebalance_left = ds_reid_index_rebalance (stage->index,
+      REBALANCE_PER_FRAME);
+  maybe_train (stage);
+
+  print_stats = stage->stats_interval &&
+      stage->frame_count % stage->stats_interval == 0;
+  g_mutex_unlock (&stage->lock);
+
+  if (print_stats)
+    ds_reid_stage_print_stats (stage);
+  return GST_PAD_PROBE_OK;
+}
+
+DsReidStage *
+ds_reid_stage_new (const gchar * cfg_file_path, const gchar * group)
+{
+  DsReidStage *stage = NULL;
+  guint dim;
+
+  if (!ds_cfg_get_int (cfg_file_path, group, "enable", 0))
+    return NULL;
+
+  stage = g_new0 (DsReidStage, 1);
+  stage->config_file = ds_cfg_get_string (cfg_file_path, group,
+      "config-file-path");
+  if (!stage->config_file)
+    stage->config_file = g_strdup ("ds_reid_config.yml");
+  stage->min_track_frames = MAX (1, ds_cfg_get_int (cfg_file_path, group,
+          "min-track-frames", 10));
+  stage->refresh_interval = MAX (1, ds_cfg_get_int (cfg_file_path, group,
+          "refresh-interval", 90));
+  stage->match_window = (gint64) (ds_cfg_get_double (cfg_file_path, group,
+          "match-window", 120.0) * G_USEC_PER_SEC);
+  stage->match_threshold = ds_cfg_get_double (cfg_file_path, group,
+      "match-threshold", 0.75);
+  stage->retrain_interval = MAX (0, ds_cfg_get_int (cfg_file_path, group,
+          "retrain-interval", 50000));
+  stage->retrain_imbalance = MAX (0.0, ds_cfg_get_double (cfg_file_path,
+          group, "retrain-imbalance", 4.0));
+  stage->stats_interval = MAX (0, ds_cfg_get_int (cfg_file_path, group,
+          "stats-interval", 900));
+
+  ds_cfg_get_class_mask (cfg_file_path, group, "operate-on-class-ids",
+      stage->class_selected);
+
+  dim = MAX (1, ds_cfg_get_int (cfg_file_path, group, "embedding-dim", 128));
+  stage->index = ds_reid_index_new (dim,
+      MAX (1, ds_cfg_get_int (cfg_file_path, group, "max-embeddings", 50000)),
+      MAX (1, ds_cfg_get_int (cfg_file_path, group, "ivf-lists", 128)),
+      MAX (1, ds_cfg_get_int (cfg_file_path, group, "ivf-probes", 8)));
+  stage->tracks = ds_track_table_new (MAX (0, ds_cfg_get_int (cfg_file_path,
+              group, "max-tracks", 4096)),
+      sizeof (DsReidTrack) + dim * sizeof (gfloat),
+      MAX (1, ds_cfg_get_int (cfg_file_path, group, "max-track-age", 60)));
+  stage->embedding = g_new0 (gfloat, dim);
+  stage->next_global_id = 1;
+
+  g_mutex_init (&stage->lock);
+  return stage;
+}
+
+const gchar *
+ds_reid_stage_get_config_file (DsReidStage * stage)
+{
+  return stage->config_file;
+}
+
+gboolean
+ds_reid_stage_attach (DsReidStage * stage, GstElement * reid_gie)
+{
+  GstPad *src_pad = NULL;
+
+  g_object_get (G_OBJECT (reid_gie), "unique-id", &stage->reid_gie_id, NULL);
+
+  /* Without this nvinfer only embeds an object again when its box grows,
+   * so stable tracks would never get fresh embeddings */
+  g_object_set (G_OBJECT (reid_gie), "secondary-reinfer-interval",
+      stage->refresh_interval, NULL);
+
+  src_pad = gst_element_get_static_pad (reid_gie, "src");
+  if (!src_pad) {
+    g_printerr ("Unable to get reid gie src pad\n");
+    return FALSE;
+  }
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      reid_src_pad_buffer_probe, stage, NULL);
+  gst_object_unref (src_pad);
+  return TRUE;
+}
+
+void
+ds_reid_stage_print_stats (DsReidStage * stage)
+{
+  g_mutex_lock (&stage->lock);
+  g_print ("ReID: embeddings %u tracks %u queries %" G_GUINT64_FORMAT
+      " matches %" G_GUINT64_FORMAT " identities %" G_GUINT64_FORMAT
+      " query-usec mean %.1f max %" G_GINT64_FORMAT " trainings %"
+      G_GUINT64_FORMAT " index-full %" G_GUINT64_FORMAT " overflows %"
+      G_GUINT64_FORMAT "%s\n",
+      ds_reid_index_size (stage->index), ds_track_table_size (stage->tracks),
+      stage->queries, stage->matches, stage->identities,
+      stage->queries ? (gdouble) stage->query_usec_total / stage->queries : 0.0,
+      stage->query_usec_max, stage->trainings, stage->index_full,
+      stage->overflows,
+      ds_reid_index_is_trained (stage->index) ? "" : " (untrained)");
+  g_mutex_unlock (&stage->lock);
+}
+
+void
+ds_reid_stage_free (DsReidStage * stage)
+{
+  if (!stage)
+    return;
+  if (stage->train_thread)
+    g_thread_join (stage->train_thread);
+  g_mutex_clear (&stage->lock);
+  ds_reid_index_free (stage->index);
+  ds_track_table_free (stage->tracks);
+  g_free (stage->train_samples);
+  g_free (stage->train_centroids);
+  g_free (stage->embedding);
+  g_free (stage->config_file);
+  g_free (stage);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __DS_REID_STAGE_H__
+#define __DS_REID_STAGE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Cross-camera re-identification.
+ *
+ * A secondary nvinfer with output-tensor-meta enabled produces an appearance
+ * embedding per object. Once a track has been seen for 'min-track-frames'
+ * frames its embedding is matched against the embeddings of the other
+ * sources stored during the last 'match-window' seconds (see
+ * ds_reid_index.h). A match above 'match-threshold' hands the track the
+ * global identity of the matched one, otherwise a new identity is created.
+ * The embedding of a live track is replaced every 'refresh-interval' frames
+ * so it stays matchable while the object is in view.
+ *
+ * The index buckets are trained once 64 embeddings per bucket are stored,
+ * and retrained after 'retrain-interval' new embeddings (0 never) or when
+ * the largest bucket reaches 'retrain-imbalance' times the mean (0 never).
+ *
+ * nvinfer only embeds an object when it is new, grew, or its
+ * secondary-reinfer-interval passed; the stage sets that interval to
+ * 'refresh-interval' and keeps the latest embedding of each track until the
+ * track is confirmed or due for a refresh.
+ *
+ * The global identity is written to misc_obj_info[DS_REID_GLOBAL_ID_FIELD]
+ * of every object meta of the track, 0 meaning not identified yet.
+ *
+ * ds_config.yml group:
+ *   reid:
+ *     enable: 1
+ *     config-file-path: ds_reid_config.yml
+ *     operate-on-class-ids: 0;2;5;7;
+ *     embedding-dim: 128
+ *     min-track-frames: 10
+ *     refresh-interval: 90
+ *     match-window: 120
+ *     match-threshold: 0.75
+ *     retrain-interval: 50000
+ *     retrain-imbalance: 4
+ *     max-embeddings: 50000
+ *     ivf-lists: 128
+ *     ivf-probes: 8
+ *     max-tracks: 4096
+ *     max-track-age: 60
+ *     stats-interval: 900
+ */
+
+#define DS_REID_GLOBAL_ID_FIELD 0
+
+typedef struct _DsReidStage DsReidStage;
+
+/* Returns NULL if the group is missing or 'enable' is not set. */
+DsReidStage *ds_reid_stage_new (const gchar * cfg_file_path,
+    const gchar * group);
+
+/* nvinfer configuration file for the embedding sgie. */
+const gchar *ds_reid_stage_get_config_file (DsReidStage * stage);
+
+/* Installs the matching probe on the src pad of 'reid_gie', which must
+ * already have its config-file-path set. */
+gboolean ds_reid_stage_attach (DsReidStage * stage, GstElement * reid_gie);
+
+void ds_reid_stage_print_stats (DsReidStage * stage);
+
+void ds_reid_stage_free (DsReidStage * stage);
+
+G_END_DECLS
+
+#endif
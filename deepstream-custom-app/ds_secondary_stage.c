@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "gstnvdsmeta.h"
+#include "ds_custom_config.h"
+#include "ds_secondary_stage.h"
+#include "ds_track_table.h"
+
+/* Labels kept per track, across all classifier metas of the sgie. */
+#define MAX_CACHED_LABELS 4
+
+/* unique_component_id given to objects the sgie must not classify. It only
+ * lives between the sgie sink and src pads. */
+#define SKIP_COMPONENT_ID 0x7fff5eed
+
+typedef struct
+{
+  guint meta_index;
+  gint component_id;
+  guint result_class_id;
+  guint label_id;
+  gfloat result_prob;
+  gchar result_label[MAX_LABEL_SIZE];
+} DsCachedLabel;
+
+typedef struct
+{
+  gboolean has_result;
+  guint64 classified_at;
+  gfloat classified_area;
+  guint num_labels;
+  DsCachedLabel labels[MAX_CACHED_LABELS];
+} DsClassifierTrack;
+
+struct _DsSecondaryStage
+{
+  gchar *config_file;
+  gint operate_on_gie_id;
+  gint sgie_unique_id;
+  gboolean class_selected[DS_CFG_MAX_CLASSES];
+  gboolean display_labels;
+  guint reclassify_interval;
+  gfloat reclassify_growth;
+  guint stats_interval;
+
+  GMutex lock;
+  DsTrackTable *tracks;
+  guint64 frame_count;
+
+  guint64 hits;
+  guint64 misses;
+  guint64 refreshes;
+  guint64 evictions;
+  guint64 overflows;
+};
+
+static void
+store_labels (DsSecondaryStage * stage, DsClassifierTrack * track,
+    NvDsObjectMeta * obj_meta)
+{
+  NvDsMetaList *l_cls, *l_label;
+  guint meta_index = 0, num_labels = 0;
+
+  for (l_cls = obj_meta->classifier_meta_list; l_cls != NULL;
+      l_cls = l_cls->next) {
+    NvDsClassifierMeta *cls_meta = (NvDsClassifierMeta *) l_cls->data;
+    if (cls_meta->unique_component_id != stage->sgie_unique_id)
+      continue;
+
+    for (l_label = cls_meta->label_info_list; l_label != NULL &&
+        num_labels < MAX_CACHED_LABELS; l_label = l_label->next) {
+      NvDsLabelInfo *label = (NvDsLabelInfo *) l_label->data;
+      DsCachedLabel *cached = &track->labels[num_labels++];
+
+      cached->meta_index = meta_index;
+      cached->component_id = cls_meta->unique_component_id;
+      cached->result_class_id = label->result_class_id;
+      cached->label_id = label->label_id;
+      cached->result_prob = label->result_prob;
+      g_strlcpy (cached->result_label, label->pResult_label ?
+          label->pResult_label : label->result_label, MAX_LABEL_SIZE);
+    }
+    meta_index++;
+  }
+
+  /* An empty result (object too small, low confidence) keeps the previous
+   * labels instead of wiping them. */
+  if (num_labels > 0)
+    track->num_labels = num_labels;
+  track->has_result = TRUE;
+}
+
+static void
+attach_labels (DsSecondaryStage * stage, NvDsBatchMeta * batch_meta,
+    NvDsObjectMeta * obj_meta, DsClassifierTrack * track)
+{
+  NvDsClassifierMeta *cls_meta = NULL;
+  guint i;
+
+  for (i = 0; i < track->num_labels; i++) {
+    DsCachedLabel *cached = &track->labels[i];
+    NvDsLabelInfo *label;
+
+    if (!cls_meta || cached->meta_index != track->labels[i - 1].meta_index) {
+      cls_meta = nvds_acquire_classifier_meta_from_pool (batch_meta);
+      cls_meta->unique_component_id = cached->component_id;
+      cls_meta->num_labels = 0;
+      nvds_add_classifier_meta_to_object (obj_meta, cls_meta);
+    }
+
+    label = nvds_acquire_label_info_meta_from_pool (batch_meta);
+    label->num_classes = 0;
+    label->result_class_id = cached->result_class_id;
+    label->label_id = cached->label_id;
+    label->result_prob = cached->result_prob;
+    label->pResult_label = NULL;
+    g_strlcpy (label->result_label, cached->result_label, MAX_LABEL_SIZE);
+    nvds_add_label_info_meta_to_classifier (cls_meta, label);
+    cls_meta->num_labels++;
+
+    /* nvinfer appends the classifier labels to the OSD text, do the same
+     * when something draws it */
+    if (stage->display_labels && obj_meta->text_params.display_text) {
+      gchar *text = g_strconcat (obj_meta->text_params.display_text, " ",
+          cached->result_label, NULL);
+      g_free (obj_meta->text_params.display_text);
+      obj_meta->text_params.display_text = text;
+    }
+  }
+}
+
+/* sgie_sink_pad_buffer_probe decides, per object, whether the sgie has to
+ * classify it or the cached result is still good. */
+static GstPadProbeReturn
+sgie_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  DsSecondaryStage *stage = (DsSecondaryStage *) u_data;
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsMetaList *l_frame = NULL;
+  NvDsMetaList *l_obj = NULL;
+  gboolean print_stats;
+
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&stage->lock);
+  stage->frame_count++;
+
+  for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
+
+    for (l_obj = frame_meta->obj_meta_list; l_obj != NULL;
+        l_obj = l_obj->next) {
+      NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) (l_obj->data);
+      DsClassifierTrack *track;
+      gboolean created;
+      gfloat area;
+
+      if (obj_meta->unique_component_id != stage->operate_on_gie_id)
+        continue;
+
+      if (!ds_cfg_class_selected (stage->class_selected,
+              obj_meta->class_id)) {
+        obj_meta->unique_component_id = SKIP_COMPONENT_ID;
+        continue;
+      }
+
+      /* Untracked objects cannot be cached, classify them every frame */
+      if (obj_meta->object_id == UNTRACKED_OBJECT_ID)
+        continue;
+
+      area = obj_meta->rect_params.width * obj_meta->rect_params.height;
+      track = ds_track_table_get (stage->tracks, frame_meta->source_id,
+          obj_meta->object_id, stage->frame_count, &created);
+      if (!track) {
+        stage->overflows++;
+        continue;
+      }
+
+      if (!track->has_result) {
+        stage->misses++;
+      } else if (area > track->classified_area * stage->reclassify_growth ||
+          stage->frame_count - track->classified_at >=
+          stage->reclassify_interval) {
+        stage->refreshes++;
+      } else {
+        stage->hits++;
+        obj_meta->unique_component_id = SKIP_COMPONENT_ID;
+        continue;
+      }
+      track->classified_area = area;
+      track->classified_at = stage->frame_count;
+    }
+  }
+
+  stage->evictions += ds_track_table_sweep (stage->tracks, stage->frame_count);
+  print_stats = stage->stats_interval &&
+      stage->frame_count % stage->stats_interval == 0;
+  g_mutex_unlock (&stage->lock);
+
+  if (print_stats)
+    ds_secondary_stage_print_stats (stage);
+  return GST_PAD_PROBE_OK;
+}
+
+/* sgie_src_pad_buffer_probe stores the fresh sgie results and attaches the
+ * cached ones to the objects the sgie skipped. */
+static GstPadProbeReturn
+sgie_src_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  DsSecondaryStage *stage = (DsSecondaryStage *) u_data;
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsMetaList *l_frame = NULL;
+  NvDsMetaList *l_obj = NULL;
+
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&stage->lock);
+
+  for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
+
+    for (l_obj = frame_meta->obj_meta_list; l_obj != NULL;
+        l_obj = l_obj->next) {
+      NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) (l_obj->data);
+      gboolean skipped = FALSE;
+      DsClassifierTrack *track;
+
+      if (obj_meta->unique_component_id == SKIP_COMPONENT_ID) {
+        obj_meta->unique_component_id = stage->operate_on_gie_id;
+        skipped = TRUE;
+      } else if (obj_meta->unique_component_id != stage->operate_on_gie_id) {
+        continue;
+      }
+
+      if (!ds_cfg_class_selected (stage->class_selected, obj_meta->class_id)
+          || obj_meta->object_id == UNTRACKED_OBJECT_ID)
+        continue;
+
+      track = ds_track_table_lookup (stage->tracks, frame_meta->source_id,
+          obj_meta->object_id, stage->frame_count);
+      if (!track)
+        continue;
+
+      if (skipped)
+        attach_labels (stage, batch_meta, obj_meta, track);
+      else
+        store_labels (stage, track, obj_meta);
+    }
+  }
+
+  g_mutex_unlock (&stage->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+DsSecondaryStage *
+ds_secondary_stage_new (const gchar * cfg_file_path, const gchar * group)
+{
+  DsSecondaryStage *stage = NULL;
+
+  if (!ds_cfg_get_int (cfg_file_path, group, "enable", 0))
+    return NULL;
+
+  stage = g_new0 (DsSecondaryStage, 1);
+  stage->config_file = ds_cfg_get_string (cfg_file_path, group,
+      "config-file-path");
+  if (!stage->config_file)
+    stage->config_file = g_strdup ("ds_sgie_config.yml");
+  stage->operate_on_gie_id = ds_cfg_get_int (cfg_file_path, group,
+      "operate-on-gie-id", 1);
+  stage->reclassify_interval = MAX (1, ds_cfg_get_int (cfg_file_path, group,
+          "reclassify-interval", 30));
+  stage->reclassify_growth = ds_cfg_get_double (cfg_file_path, group,
+      "reclassify-growth", 1.5);
+  stage->stats_interval = MAX (0, ds_cfg_get_int (cfg_file_path, group,
+          "stats-interval", 900));
+
+  ds_cfg_get_class_mask (cfg_file_path, group, "operate-on-class-ids",
+      stage->class_selected);
+
+  stage->tracks = ds_track_table_new (MAX (0, ds_cfg_get_int (cfg_file_path,
+              group, "cache-size", 4096)), sizeof (DsClassifierTrack),
+      MAX (1, ds_cfg_get_int (cfg_file_path, group, "max-track-age", 60)));
+
+  stage->display_labels = TRUE;
+  g_mutex_init (&stage->lock);
+  return stage;
+}
+
+const gchar *
+ds_secondary_stage_get_config_file (DsSecondaryStage * stage)
+{
+  return stage->config_file;
+}
+
+void
+ds_secondary_stage_set_display_labels (DsSecondaryStage * stage,
+    gboolean display_labels)
+{
+  stage->display_labels = display_labels;
+}
+
+gboolean
+ds_secondary_stage_attach (DsSecondaryStage * stage, GstElement * sgie)
+{
+  GstPad *sink_pad = NULL, *src_pad = NULL;
+
+  g_object_get (G_OBJECT (sgie), "unique-id", &stage->sgie_unique_id, NULL);
+
+  /* The skip trick relies on the sgie filtering objects by component id */
+  g_object_set (G_OBJECT (sgie), "infer-on-gie-id", stage->operate_on_gie_id,
+      NULL);
+
+  /* nvinfer keeps its own per object result history and would re-attach an
+   * old result instead of running when the stage asks for a refresh */
+  g_object_set (G_OBJECT (sgie), "secondary-reinfer-interval", 0, NULL);
+
+  sink_pad = gst_element_get_static_pad (sgie, "sink");
+  src_pad = gst_element_get_static_pad (sgie, "src");
+  if (!sink_pad || !src_pad) {
+    g_printerr ("Unable to get sgie pads\n");
+    if (sink_pad)
+      gst_object_unref (sink_pad);
+    if (src_pad)
+      gst_object_unref (src_pad);
+    return FALSE;
+  }
+
+  gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      sgie_sink_pad_buffer_probe, stage, NULL);
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      sgie_src_pad_buffer_probe, stage, NULL);
+  gst_object_unref (sink_pad);
+  gst_object_unref (src_pad);
+  return TRUE;
+}
+
+void
+ds_secondary_stage_print_stats (DsSecondaryStage * stage)
+{
+  guint64 lookups;
+
+  g_mutex_lock (&stage->lock);
+  lookups = stage->hits + stage->misses + stage->refreshes;
+  g_print ("Secondary cache: tracks %u/%u hits %" G_GUINT64_FORMAT
+      " misses %" G_GUINT64_FORMAT " refreshes %" G_GUINT64_FORMAT
+      " evictions %" G_GUINT64_FORMAT " overflows %" G_GUINT64_FORMAT
+      " hit-rate %.1f%%\n", ds_track_table_size (stage->tracks),
+      ds_track_table_max_size (stage->tracks),
+      stage->hits, stage->misses, stage->refreshes, stage->evictions,
+      stage->overflows, lookups ? 100.0 * stage->hits / lookups : 0.0);
+  g_mutex_unlock (&stage->lock);
+}
+
+void
+ds_secondary_stage_free (DsSecondaryStage * stage)
+{
+  if (!stage)
+    return;
+  g_mutex_clear (&stage->lock);
+  ds_track_table_free (stage->tracks);
+  g_free (stage->config_file);
+  g_free (stage);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __DS_SECONDARY_STAGE_H__
+#define __DS_SECONDARY_STAGE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Optional secondary classifier (sgie) placed right after nvtracker.
+ *
+ * Classifying every object of every frame is wasteful: the attributes of a
+ * tracked object (vehicle type, color, ...) rarely change. The stage keeps the
+ * last classification of each (source_id, object_id) track in a fixed size
+ * open addressing table and only lets the sgie see an object when
+ *   - the track is new,
+ *   - its box grew by more than 'reclassify-growth' since the last run, or
+ *   - 'reclassify-interval' frames passed since the last run.
+ * Every other object is hidden from the sgie by temporarily changing its
+ * unique_component_id on the sgie sink pad. On the sgie src pad the id is
+ * restored and the cached labels are attached as NvDsClassifierMeta, so
+ * downstream elements see the same metadata as if the sgie had run.
+ *
+ * The stage is the only result cache: nvinfer's own object history is
+ * disabled (secondary-reinfer-interval 0) so that every object it lets
+ * through is really classified.
+ *
+ * Tracks that were not seen for 'max-track-age' frames (the tracker already
+ * dropped them) are evicted by an incremental sweep, a few slots per frame.
+ * No memory is allocated after ds_secondary_stage_new () unless cached
+ * labels are appended to the OSD text, see
+ * ds_secondary_stage_set_display_labels ().
+ *
+ * ds_config.yml group (all keys optional except enable):
+ *   secondary-gie:
+ *     enable: 1
+ *     config-file-path: ds_sgie_config.yml
+ *     operate-on-gie-id: 1
+ *     operate-on-class-ids: 2;5;7;
+ *     cache-size: 4096
+ *     reclassify-interval: 30
+ *     reclassify-growth: 1.5
+ *     max-track-age: 60
+ *     stats-interval: 900
+ */
+
+typedef struct _DsSecondaryStage DsSecondaryStage;
+
+/* Returns NULL if the group is missing or 'enable' is not set. */
+DsSecondaryStage *ds_secondary_stage_new (const gchar * cfg_file_path,
+    const gchar * group);
+
+/* nvinfer configuration file for the sgie element. */
+const gchar *ds_secondary_stage_get_config_file (DsSecondaryStage * stage);
+
+/* Whether cached labels are appended to the object display text like
+ * nvinfer does. Defaults to TRUE; turn it off when nothing draws the OSD. */
+void ds_secondary_stage_set_display_labels (DsSecondaryStage * stage,
+    gboolean display_labels);
+
+/* Installs the cache probes on the sink and src pads of 'sgie', which must
+ * already have its config-file-path set. */
+gboolean ds_secondary_stage_attach (DsSecondaryStage * stage,
+    GstElement * sgie);
+
+void ds_secondary_stage_print_stats (DsSecondaryStage * stage);
+
+void ds_secondary_stage_free (DsSecondaryStage * stage);
+
+G_END_DECLS
+
+#endif
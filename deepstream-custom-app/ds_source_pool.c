@@ -0,0 +1,589 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "gstnvdsmeta.h"
+#include "ds_custom_config.h"
+#include "ds_source_pool.h"
+
+/* NVIDIA Decoder source pad memory feature. This feature signifies that source
+ * pads having this capability will push GstBuffers containing cuda buffers. */
+#define GST_CAPS_FEATURES_NVMM "memory:NVMM"
+
+typedef enum
+{
+  SOURCE_WAITING,
+  SOURCE_STARTING,
+  SOURCE_CONNECTED,
+  SOURCE_FAILED,
+} DsSourceState;
+
+typedef struct
+{
+  DsSourcePool *pool;
+  guint index;
+  gchar *uri;
+  GstElement *bin;
+  /* Network streams, their EOS means a disconnection */
+  gboolean live;
+
+  /* Protected by the pool lock. Times are monotonic, 0 meaning not yet. */
+  DsSourceState state;
+  guint attempts;
+  gint64 started_at;
+  gint64 connected_at;
+  gint64 first_inference_at;
+  guint stop_id;
+  guint retry_id;
+} DsSource;
+
+struct _DsSourcePool
+{
+  GstElement *pipeline;
+  GstElement *streammux;
+  gboolean file_loop;
+  guint64 connect_timeout;
+  guint retry_interval;
+
+  GMutex lock;
+  GPtrArray *sources;
+  GThreadPool *starter;
+  gboolean stopping;
+
+  /* Sources started but without a first inference, read without the lock
+   * by the probe */
+  gint num_waiting;
+};
+
+static const gchar *
+source_state_name (DsSourceState state)
+{
+  switch (state) {
+    case SOURCE_WAITING:
+      return "waiting";
+    case SOURCE_STARTING:
+      return "connecting";
+    case SOURCE_CONNECTED:
+      return "connected";
+    case SOURCE_FAILED:
+      return "failed";
+  }
+  return "unknown";
+}
+
+static gdouble
+seconds_between (gint64 from, gint64 to)
+{
+  return (to - from) / (gdouble) G_USEC_PER_SEC;
+}
+
+static void
+cb_newpad (GstElement * decodebin, GstPad * decoder_src_pad, gpointer data)
+{
+  DsSource *source = (DsSource *) data;
+  GstCaps *caps = gst_pad_get_current_caps (decoder_src_pad);
+  if (!caps) {
+    caps = gst_pad_query_caps (decoder_src_pad, NULL);
+  }
+  const GstStructure *str = gst_caps_get_structure (caps, 0);
+  const gchar *name = gst_structure_get_name (str);
+  GstCapsFeatures *features = gst_caps_get_features (caps, 0);
+
+  /* Need to check if the pad created by the decodebin is for video and not
+   * audio. */
+  if (!strncmp (name, "video", 5)) {
+    /* Link the decodebin pad only if decodebin has picked nvidia
+     * decoder plugin nvdec_*. We do this by checking if the pad caps contain
+     * NVMM memory features. */
+    if (gst_caps_features_contains (features, GST_CAPS_FEATURES_NVMM)) {
+      /* Get the source bin ghost pad */
+      GstPad *bin_ghost_pad = gst_element_get_static_pad (source->bin, "src");
+      if (!gst_ghost_pad_set_target (GST_GHOST_PAD (bin_ghost_pad),
+              decoder_src_pad)) {
+        g_printerr ("Failed to link decoder src pad to source bin ghost pad\n");
+      } else {
+        gint64 now = g_get_monotonic_time ();
+        g_mutex_lock (&source->pool->lock);
+        source->state = SOURCE_CONNECTED;
+        source->connected_at = now;
+        g_print ("Source %u connected in %.2f s\n", source->index,
+            seconds_between (source->started_at, now));
+        g_mutex_unlock (&source->pool->lock);
+      }
+      gst_object_unref (bin_ghost_pad);
+    } else {
+      g_printerr ("Error: Decodebin did not pick nvidia decoder plugin.\n");
+    }
+  }
+  gst_caps_unref (caps);
+}
+
+static void
+decodebin_child_added (GstChildProxy * child_proxy, GObject * object,
+    gchar * name, gpointer user_data)
+{
+  DsSource *source = (DsSource *) user_data;
+
+  if (g_strrstr (name, "decodebin") == name) {
+    g_signal_connect (G_OBJECT (object), "child-added",
+        G_CALLBACK (decodebin_child_added), user_data);
+  }
+  if (g_strrstr (name, "source") == name) {
+    /* Only rtspsrc has these */
+    GObjectClass *klass = G_OBJECT_GET_CLASS (object);
+    if (g_object_class_find_property (klass, "drop-on-latency")) {
+      g_object_set (object, "drop-on-latency", TRUE, NULL);
+    }
+    if (g_object_class_find_property (klass, "tcp-timeout")) {
+      g_object_set (object, "tcp-timeout", source->pool->connect_timeout,
+          NULL);
+    }
+  }
+}
+
+static GstElement *
+create_source_bin (DsSource * source)
+{
+  GstElement *bin = NULL, *uri_decode_bin = NULL;
+  gchar bin_name[16] = { };
+
+  g_snprintf (bin_name, 15, "source-bin-%02d", source->index);
+  /* Create a source GstBin to abstract this bin's content from the rest of the
+   * pipeline */
+  bin = gst_bin_new (bin_name);
+
+  /* Source element for reading from the uri.
+   * We will use decodebin and let it figure out the container format of the
+   * stream and the codec and plug the appropriate demux and decode plugins. */
+  if (source->pool->file_loop) {
+    uri_decode_bin = gst_element_factory_make ("nvurisrcbin", "uri-decode-bin");
+    g_object_set (G_OBJECT (uri_decode_bin), "file-loop", TRUE, NULL);
+  } else {
+    uri_decode_bin = gst_element_factory_make ("uridecodebin", "uri-decode-bin");
+  }
+
+  if (!bin || !uri_decode_bin) {
+    g_printerr ("One element in source bin could not be created.\n");
+    return NULL;
+  }
+
+  /* We set the input uri to the source element */
+  g_object_set (G_OBJECT (uri_decode_bin), "uri", source->uri, NULL);
+
+  /* Connect to the "pad-added" signal of the decodebin which generates a
+   * callback once a new pad for raw data has beed created by the decodebin */
+  g_signal_connect (G_OBJECT (uri_decode_bin), "pad-added",
+      G_CALLBACK (cb_newpad), source);
+  g_signal_connect (G_OBJECT (uri_decode_bin), "child-added",
+      G_CALLBACK (decodebin_child_added), source);
+
+  gst_bin_add (GST_BIN (bin), uri_decode_bin);
+
+  /* We need to create a ghost pad for the source bin which will act as a proxy
+   * for the video decoder src pad. The ghost pad will not have a target right
+   * now. Once the decode bin creates the video decoder and generates the
+   * cb_newpad callback, we will set the ghost pad target to the video decoder
+   * src pad. */
+  if (!gst_element_add_pad (bin, gst_ghost_pad_new_no_target ("src",
+              GST_PAD_SRC))) {
+    g_printerr ("Failed to add ghost pad in source bin\n");
+    return NULL;
+  }
+
+  return bin;
+}
+
+/* Runs on the starter threads. */
+static void
+start_source (gpointer data, gpointer user_data)
+{
+  DsSource *source = (DsSource *) data;
+  DsSourcePool *pool = (DsSourcePool *) user_data;
+
+  g_mutex_lock (&pool->lock);
+  if (pool->stopping) {
+    g_mutex_unlock (&pool->lock);
+    return;
+  }
+  if (source->first_inference_at) {
+    g_atomic_int_inc (&pool->num_waiting);
+  }
+  source->state = SOURCE_STARTING;
+  source->attempts++;
+  source->started_at = g_get_monotonic_time ();
+  source->connected_at = 0;
+  source->first_inference_at = 0;
+  g_mutex_unlock (&pool->lock);
+
+  /* Joins the state of the already playing pipeline */
+  gst_element_set_locked_state (source->bin, FALSE);
+  if (!gst_element_sync_state_with_parent (source->bin)) {
+    g_printerr ("Failed to start source %u\n", source->index);
+  }
+}
+
+static gboolean
+retry_source (gpointer data)
+{
+  DsSource *source = (DsSource *) data;
+  DsSourcePool *pool = source->pool;
+
+  g_mutex_lock (&pool->lock);
+  source->retry_id = 0;
+  g_mutex_unlock (&pool->lock);
+
+  g_thread_pool_push (pool->starter, source, NULL);
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs on the main loop, state changes cannot be made from the streaming
+ * thread that posted the error. */
+static gboolean
+stop_failed_source (gpointer data)
+{
+  DsSource *source = (DsSource *) data;
+  DsSourcePool *pool = source->pool;
+
+  gst_element_set_locked_state (source->bin, TRUE);
+  gst_element_set_state (source->bin, GST_STATE_NULL);
+
+  g_mutex_lock (&pool->lock);
+  source->stop_id = 0;
+  if (pool->retry_interval > 0 && !pool->stopping) {
+    g_print ("Retrying source %u in %u s\n", source->index,
+        pool->retry_interval);
+    source->retry_id = g_timeout_add_seconds (pool->retry_interval,
+        retry_source, source);
+  }
+  g_mutex_unlock (&pool->lock);
+  return G_SOURCE_REMOVE;
+}
+
+/* Stops the source from the main loop and schedules its retry. Called with
+ * the pool lock held. */
+static void
+fail_source (DsSource * source)
+{
+  if (source->state != SOURCE_FAILED && !source->pool->stopping) {
+    source->state = SOURCE_FAILED;
+    source->stop_id = g_idle_add (stop_failed_source, source);
+  }
+}
+
+/* Keeps errors of a single network source from reaching bus_call, which
+ * would stop the whole pipeline. File sources are not retried: replaying
+ * them would duplicate their analytics and a missing file never recovers,
+ * so their errors still end the pipeline. */
+static GstBusSyncReply
+source_bus_sync_handler (GstBus * bus, GstMessage * msg, gpointer data)
+{
+  DsSourcePool *pool = (DsSourcePool *) data;
+  DsSource *source = NULL;
+  GError *error = NULL;
+  gchar *debug = NULL;
+  guint i;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_ERROR)
+    return GST_BUS_PASS;
+
+  for (i = 0; i < pool->sources->len && !source; i++) {
+    DsSource *candidate = g_ptr_array_index (pool->sources, i);
+    if (candidate && candidate->bin && gst_object_has_as_ancestor (GST_MESSAGE_SRC (msg),
+            GST_OBJECT (candidate->bin)))
+      source = candidate;
+  }
+  if (!source || !source->live)
+    return GST_BUS_PASS;
+
+  gst_message_parse_error (msg, &error, &debug);
+  g_printerr ("ERROR from source %u (%s): %s\n", source->index,
+      GST_OBJECT_NAME (msg->src), error->message);
+  if (debug)
+    g_printerr ("Error details: %s\n", debug);
+  g_free (debug);
+  g_error_free (error);
+
+  g_mutex_lock (&pool->lock);
+  fail_source (source);
+  g_mutex_unlock (&pool->lock);
+  return GST_BUS_DROP;
+}
+
+/* A camera or RTSP server that disconnects ends its stream with EOS, which
+ * would EOS the streammux and make bus_call quit. It is handled like an
+ * error of that source instead. */
+static GstPadProbeReturn
+source_eos_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  DsSource *source = (DsSource *) u_data;
+
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) != GST_EVENT_EOS)
+    return GST_PAD_PROBE_OK;
+
+  g_printerr ("EOS from source %u, stream ended\n", source->index);
+  g_mutex_lock (&source->pool->lock);
+  fail_source (source);
+  g_mutex_unlock (&source->pool->lock);
+  return GST_PAD_PROBE_DROP;
+}
+
+/* first_inference_probe records when the first frame of each started source
+ * leaves the primary detector. */
+static GstPadProbeReturn
+first_inference_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  DsSourcePool *pool = (DsSourcePool *) u_data;
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsMetaList *l_frame = NULL;
+  gint64 now;
+
+  if (g_atomic_int_get (&pool->num_waiting) == 0)
+    return GST_PAD_PROBE_OK;
+
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+
+  now = g_get_monotonic_time ();
+  g_mutex_lock (&pool->lock);
+  for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
+    DsSource *source;
+
+    if (frame_meta->source_id >= pool->sources->len)
+      continue;
+    source = g_ptr_array_index (pool->sources, frame_meta->source_id);
+    if (!source || !source->started_at || source->first_inference_at)
+      continue;
+
+    source->first_inference_at = now;
+    g_atomic_int_add (&pool->num_waiting, -1);
+    g_print ("Source %u: first inference %.2f s after start\n",
+        source->index, seconds_between (source->started_at, now));
+  }
+  g_mutex_unlock (&pool->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+DsSourcePool *
+ds_source_pool_new (const gchar * cfg_file_path, const gchar * group,
+    GstElement * pipeline, GstElement * streammux, gboolean file_loop)
+{
+  DsSourcePool *pool = g_new0 (DsSourcePool, 1);
+  gdouble connect_timeout = 10.0;
+  gint retry_interval = 10;
+  GstBus *bus;
+
+  if (ds_cfg_is_yml (cfg_file_path)) {
+    connect_timeout = ds_cfg_get_double (cfg_file_path, group,
+        "connect-timeout", connect_timeout);
+    retry_interval = ds_cfg_get_int (cfg_file_path, group, "retry-interval",
+        retry_interval);
+  }
+
+  pool->pipeline = pipeline;
+  pool->streammux = streammux;
+  pool->file_loop = file_loop;
+  pool->connect_timeout = (guint64) (MAX (connect_timeout, 1.0) *
+      G_USEC_PER_SEC);
+  pool->retry_interval = MAX (retry_interval, 0);
+  pool->sources = g_ptr_array_new ();
+  g_mutex_init (&pool->lock);
+
+  /* A thread per connecting source, so none waits behind another */
+  pool->starter = g_thread_pool_new (start_source, pool, -1, FALSE, NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_set_sync_handler (bus, source_bus_sync_handler, pool, NULL);
+  gst_object_unref (bus);
+  return pool;
+}
+
+gboolean
+ds_source_pool_add (DsSourcePool * pool, guint index, const gchar * uri)
+{
+  DsSource *source = g_new0 (DsSource, 1);
+  GstPad *sinkpad, *srcpad;
+  gchar pad_name[16] = { };
+
+  source->pool = pool;
+  source->index = index;
+  source->uri = g_strdup (uri);
+  source->live = !pool->file_loop && !g_str_has_prefix (uri, "file://");
+  source->state = SOURCE_WAITING;
+  if (index >= pool->sources->len) {
+    g_ptr_array_set_size (pool->sources, index + 1);
+  }
+  g_ptr_array_index (pool->sources, index) = source;
+
+  source->bin = create_source_bin (source);
+  if (!source->bin) {
+    return FALSE;
+  }
+
+  /* Left in NULL when the pipeline changes state, ds_source_pool_start ()
+   * brings it up on its own */
+  gst_element_set_locked_state (source->bin, TRUE);
+  gst_bin_add (GST_BIN (pool->pipeline), source->bin);
+
+  g_snprintf (pad_name, 15, "sink_%u", index);
+  sinkpad = gst_element_get_request_pad (pool->streammux, pad_name);
+  if (!sinkpad) {
+    g_printerr ("Streammux request sink pad failed.\n");
+    return FALSE;
+  }
+
+  srcpad = gst_element_get_static_pad (source->bin, "src");
+  if (!srcpad) {
+    g_printerr ("Failed to get src pad of source bin.\n");
+    gst_object_unref (sinkpad);
+    return FALSE;
+  }
+
+  if (gst_pad_link (srcpad, sinkpad) != GST_PAD_LINK_OK) {
+    g_printerr ("Failed to link source bin to stream muxer.\n");
+    gst_object_unref (srcpad);
+    gst_object_unref (sinkpad);
+    return FALSE;
+  }
+
+  if (source->live) {
+    gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        source_eos_probe, source, NULL);
+  }
+
+  gst_object_unref (srcpad);
+  gst_object_unref (sinkpad);
+  g_atomic_int_inc (&pool->num_waiting);
+  return TRUE;
+}
+
+gboolean
+ds_source_pool_attach (DsSourcePool * pool, GstElement * pgie)
+{
+  GstPad *src_pad = gst_element_get_static_pad (pgie, "src");
+
+  if (!src_pad) {
+    g_printerr ("Unable to get primary detector src pad\n");
+    return FALSE;
+  }
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      first_inference_probe, pool, NULL);
+  gst_object_unref (src_pad);
+  return TRUE;
+}
+
+void
+ds_source_pool_start (DsSourcePool * pool)
+{
+  guint i;
+
+  for (i = 0; i < pool->sources->len; i++) {
+    DsSource *source = g_ptr_array_index (pool->sources, i);
+    if (source) {
+      g_thread_pool_push (pool->starter, source, NULL);
+    }
+  }
+}
+
+void
+ds_source_pool_stop (DsSourcePool * pool)
+{
+  GstBus *bus;
+  guint i;
+
+  if (!pool->starter)
+    return;
+
+  g_mutex_lock (&pool->lock);
+  pool->stopping = TRUE;
+  for (i = 0; i < pool->sources->len; i++) {
+    DsSource *source = g_ptr_array_index (pool->sources, i);
+    if (!source)
+      continue;
+    if (source->stop_id) {
+      g_source_remove (source->stop_id);
+      source->stop_id = 0;
+    }
+    if (source->retry_id) {
+      g_source_remove (source->retry_id);
+      source->retry_id = 0;
+    }
+  }
+  g_mutex_unlock (&pool->lock);
+
+  /* Lets the starts in progress finish, drops the queued ones */
+  g_thread_pool_free (pool->starter, TRUE, TRUE);
+  pool->starter = NULL;
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pool->pipeline));
+  gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+  gst_object_unref (bus);
+}
+
+void
+ds_source_pool_print_stats (DsSourcePool * pool)
+{
+  guint i;
+
+  g_mutex_lock (&pool->lock);
+  for (i = 0; i < pool->sources->len; i++) {
+    DsSource *source = g_ptr_array_index (pool->sources, i);
+    if (!source)
+      continue;
+
+    g_print ("Source %u: %s, %u start(s)", source->index,
+        source_state_name (source->state), source->attempts);
+    if (source->connected_at)
+      g_print (", connected in %.2f s",
+          seconds_between (source->started_at, source->connected_at));
+    if (source->first_inference_at)
+      g_print (", first inference after %.2f s",
+          seconds_between (source->started_at, source->first_inference_at));
+    g_print ("\n");
+  }
+  g_mutex_unlock (&pool->lock);
+}
+
+void
+ds_source_pool_free (DsSourcePool * pool)
+{
+  guint i;
+
+  if (!pool)
+    return;
+
+  ds_source_pool_stop (pool);
+  for (i = 0; i < pool->sources->len; i++) {
+    DsSource *source = g_ptr_array_index (pool->sources, i);
+    if (source) {
+      g_free (source->uri);
+      g_free (source);
+    }
+  }
+  g_ptr_array_free (pool->sources, TRUE);
+  g_mutex_clear (&pool->lock);
+  g_free (pool);
+}
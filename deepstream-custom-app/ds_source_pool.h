@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __DS_SOURCE_POOL_H__
+#define __DS_SOURCE_POOL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Source bins that start independently of the pipeline and of each other.
+ *
+ * Every source bin is linked to its streammux sink pad but keeps its state
+ * locked, so setting the pipeline to PLAYING does not wait for any camera.
+ * ds_source_pool_start () then brings every source up from its own worker
+ * thread. Each source joins the live streammux batches as soon as its
+ * decoder is linked; until then the batches are simply formed without it.
+ *
+ * An error posted from inside a network source bin only stops that source:
+ * the message is dropped from the bus so the main loop keeps running, and
+ * the source is restarted after 'retry-interval' seconds (0 never retries).
+ * The EOS of a network source (a disconnected camera or RTSP server) is
+ * handled the same way. File sources keep the usual behaviour: an error
+ * stops the pipeline and their EOS ends it.
+ * RTSP cameras give up connecting after 'connect-timeout' seconds.
+ *
+ * The time from start to connection and to the first frame out of the
+ * primary detector is recorded for every source, and printed when it
+ * happens and in ds_source_pool_print_stats ().
+ *
+ * ds_config.yml group:
+ *   source-startup:
+ *     connect-timeout: 10
+ *     retry-interval: 10
+ */
+
+typedef struct _DsSourcePool DsSourcePool;
+
+/* Never returns NULL, defaults are used when 'cfg_file_path' is not a yml
+ * file or lacks the group. With 'file_loop' sources use nvurisrcbin and
+ * loop over files. */
+DsSourcePool *ds_source_pool_new (const gchar * cfg_file_path,
+    const gchar * group, GstElement * pipeline, GstElement * streammux,
+    gboolean file_loop);
+
+/* Creates the source bin of 'uri', adds it to the pipeline and links it to
+ * streammux sink pad 'index'. */
+gboolean ds_source_pool_add (DsSourcePool * pool, guint index,
+    const gchar * uri);
+
+/* Installs the time to first inference probe on the src pad of 'pgie'. */
+gboolean ds_source_pool_attach (DsSourcePool * pool, GstElement * pgie);
+
+/* Starts every source without waiting for them. Call once the pipeline is
+ * PLAYING. */
+void ds_source_pool_start (DsSourcePool * pool);
+
+/* Cancels pending starts and retries. Call before stopping the pipeline. */
+void ds_source_pool_stop (DsSourcePool * pool);
+
+void ds_source_pool_print_stats (DsSourcePool * pool);
+
+void ds_source_pool_free (DsSourcePool * pool);
+
+G_END_DECLS
+
+#endif
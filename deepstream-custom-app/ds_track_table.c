@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "ds_track_table.h"
+
+typedef struct
+{
+  gboolean used;
+  guint source_id;
+  guint64 object_id;
+  guint64 last_seen;
+} DsTrackEntry;
+
+/* Values are stored right after each entry header, 8 byte aligned. */
+#define ENTRY_HEADER_SIZE ((sizeof (DsTrackEntry) + 7) & ~(gsize) 7)
+
+struct _DsTrackTable
+{
+  guint8 *slots;
+  gsize slot_size;
+  gsize value_size;
+  guint capacity;
+  guint mask;
+  guint max_entries;
+  guint num_entries;
+  guint64 max_age;
+  guint sweep_cursor;
+  guint sweep_per_call;
+};
+
+static inline DsTrackEntry *
+slot_entry (DsTrackTable * table, guint idx)
+{
+  return (DsTrackEntry *) (table->slots + (gsize) idx * table->slot_size);
+}
+
+static inline gpointer
+entry_value (DsTrackEntry * entry)
+{
+  return (guint8 *) entry + ENTRY_HEADER_SIZE;
+}
+
+static inline guint
+home_slot (DsTrackTable * table, guint source_id, guint64 object_id)
+{
+  /* splitmix64 finalizer, tracker ids are sequential */
+  guint64 h = object_id ^ ((guint64) source_id << 56);
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return (guint) h & table->mask;
+}
+
+static inline gboolean
+expired (DsTrackTable * table, DsTrackEntry * entry, guint64 now)
+{
+  return now > entry->last_seen && now - entry->last_seen > table->max_age;
+}
+
+static DsTrackEntry *
+find (DsTrackTable * table, guint source_id, guint64 object_id)
+{
+  guint idx = home_slot (table, source_id, object_id);
+  DsTrackEntry *entry;
+
+  while ((entry = slot_entry (table, idx))->used) {
+    if (entry->object_id == object_id && entry->source_id == source_id)
+      return entry;
+    idx = (idx + 1) & table->mask;
+  }
+  return NULL;
+}
+
+/* Backward shift deletion: keeps probe sequences intact without tombstones. */
+static void
+remove_slot (DsTrackTable * table, guint idx)
+{
+  guint next = idx;
+
+  for (;;) {
+    DsTrackEntry *entry;
+    guint home;
+
+    next = (next + 1) & table->mask;
+    entry = slot_entry (table, next);
+    if (!entry->used)
+      break;
+
+    /* The entry may move into the hole only if its home slot does not lie
+     * cyclically in (idx, next]. */
+    home = home_slot (table, entry->source_id, entry->object_id);
+    if ((next > idx && (home <= idx || home > next)) ||
+        (next < idx && (home <= idx && home > next))) {
+      memcpy (slot_entry (table, idx), entry, table->slot_size);
+      idx = next;
+    }
+  }
+
+  slot_entry (table, idx)->used = FALSE;
+  table->num_entries--;
+}
+
+DsTrackTable *
+ds_track_table_new (guint max_tracks, gsize value_size, guint64 max_age)
+{
+  DsTrackTable *table = g_new0 (DsTrackTable, 1);
+
+  /* Keep the load factor under 3/4 so probe sequences stay short */
+  max_tracks = MAX (max_tracks, 16);
+  table->capacity = 16;
+  while (table->capacity < max_tracks + max_tracks / 3)
+    table->capacity <<= 1;
+  table->mask = table->capacity - 1;
+  table->max_entries = max_tracks;
+  table->value_size = value_size;
+  table->slot_size = ENTRY_HEADER_SIZE + ((value_size + 7) & ~(gsize) 7);
+  table->slots = g_malloc0 (table->slot_size * table->capacity);
+  table->max_age = MAX (max_age, 1);
+  table->sweep_per_call = table->capacity / MIN (table->max_age,
+      table->capacity) + 1;
+  return table;
+}
+
+void
+ds_track_table_free (DsTrackTable * table)
+{
+  if (!table)
+    return;
+  g_free (table->slots);
+  g_free (table);
+}
+
+gpointer
+ds_track_table_lookup (DsTrackTable * table, guint source_id,
+    guint64 object_id, guint64 now)
+{
+  DsTrackEntry *entry = find (table, source_id, object_id);
+
+  if (!entry || expired (table, entry, now))
+    return NULL;
+  return entry_value (entry);
+}
+
+gpointer
+ds_track_table_get (DsTrackTable * table, guint source_id,
+    guint64 object_id, guint64 now, gboolean * created)
+{
+  DsTrackEntry *entry = find (table, source_id, object_id);
+  guint idx;
+
+  *created = FALSE;
+  if (entry) {
+    if (expired (table, entry, now)) {
+      memset (entry_value (entry), 0, table->value_size);
+      *created = TRUE;
+    }
+    entry->last_seen = now;
+    return entry_value (entry);
+  }
+
+  if (table->num_entries >= table->max_entries)
+    return NULL;
+
+  idx = home_slot (table, source_id, object_id);
+  while (slot_entry (table, idx)->used)
+    idx = (idx + 1) & table->mask;
+
+  entry = slot_entry (table, idx);
+  entry->used = TRUE;
+  entry->source_id = source_id;
+  entry->object_id = object_id;
+  entry->last_seen = now;
+  memset (entry_value (entry), 0, table->value_size);
+  table->num_entries++;
+  *created = TRUE;
+  return entry_value (entry);
+}
+
+guint
+ds_track_table_sweep (DsTrackTable * table, guint64 now)
+{
+  guint n = 0, evicted = 0;
+
+  while (n < table->sweep_per_call) {
+    DsTrackEntry *entry = slot_entry (table, table->sweep_cursor);
+    if (entry->used && expired (table, entry, now)) {
+      /* A neighbour may be shifted into this slot, check it again without
+       * using up the slice */
+      remove_slot (table, table->sweep_cursor);
+      evicted++;
+      continue;
+    }
+    table->sweep_cursor = (table->sweep_cursor + 1) & table->mask;
+    n++;
+  }
+  return evicted;
+}
+
+guint
+ds_track_table_size (DsTrackTable * table)
+{
+  return table->num_entries;
+}
+
+guint
+ds_track_table_max_size (DsTrackTable * table)
+{
+  return table->max_entries;
+}
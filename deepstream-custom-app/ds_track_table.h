@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __DS_TRACK_TABLE_H__
+#define __DS_TRACK_TABLE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Fixed size hash table keyed by (source_id, object_id) holding a caller
+ * defined value per tracked object.
+ *
+ * All memory is allocated by ds_track_table_new (). Lookups use linear
+ * probing and removals use backward shift deletion, so values may move
+ * between slots: never keep a value pointer across calls that can remove
+ * entries (ds_track_table_sweep).
+ *
+ * Entries carry the 'now' of their last ds_track_table_get () call. Entries
+ * older than 'max_age' are dropped by ds_track_table_sweep (), which visits a
+ * slice of the table per call so that the whole table is covered every
+ * 'max_age' calls. 'now' is any monotonic clock, e.g. a frame counter.
+ *
+ * Not thread safe, callers serialize access. */
+
+typedef struct _DsTrackTable DsTrackTable;
+
+DsTrackTable *ds_track_table_new (guint max_tracks, gsize value_size,
+    guint64 max_age);
+
+void ds_track_table_free (DsTrackTable * table);
+
+/* Returns the value of the track, or NULL if it is not in the table. An
+ * expired entry that was not swept yet is reported as missing. */
+gpointer ds_track_table_lookup (DsTrackTable * table, guint source_id,
+    guint64 object_id, guint64 now);
+
+/* Returns the value of the track and marks it as seen at 'now'. A new or
+ * expired track gets a zeroed value and '*created' is set. Returns NULL if
+ * the table already holds 'max_tracks' tracks. */
+gpointer ds_track_table_get (DsTrackTable * table, guint source_id,
+    guint64 object_id, guint64 now, gboolean * created);
+
+/* Evicts expired tracks from the next slice of the table and returns how
+ * many were evicted. */
+guint ds_track_table_sweep (DsTrackTable * table, guint64 now);
+
+guint ds_track_table_size (DsTrackTable * table);
+
+guint ds_track_table_max_size (DsTrackTable * table);
+
+G_END_DECLS
+
+#endif